@@ -0,0 +1,540 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "batchFiles.h"
+#include "intChain.h"
+
+// batchFiles.c
+// Runs one transformation over many files, overlapping their I/O with the transformation.
+
+// Files between being opened for reading and being written out, per worker thread:
+#define WINDOW_PER_WORKER 4
+
+// Completion tag of the read that waits on the workers' eventfd:
+#define WORKER_EVENT UINT64_MAX
+
+// Where a file is in the batch:
+#define STAGE_READ 1
+#define STAGE_TRANSFORM 2
+#define STAGE_WRITE 3
+
+struct batchFile {
+	int fd;
+	uint32_t stage;
+	uint8_t* data;
+	uint64_t length;
+	uint64_t done;          // bytes read or written so far
+};
+
+// Minimal io_uring, set up with raw system calls:
+//  If the kernel refuses io_uring, fd is -1 and every operation runs synchronously when submitted,
+//  its completion queued in fallback for ringWait to hand back in order.
+struct ring {
+	int fd;
+	uint32_t* sqTail;
+	uint32_t* sqMask;
+	uint32_t* sqArray;
+	uint32_t* cqHead;
+	uint32_t* cqTail;
+	uint32_t* cqMask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	size_t sqesSize;
+	struct io_uring_cqe* fallback;
+	uint32_t fallbackHead;
+	uint32_t fallbackCount;
+	uint32_t entries;
+};
+
+// Queues shared between the I/O thread and the workers:
+//  Every file is pushed once onto each, so arrays of count entries never overflow.
+static struct batchQueues {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;       // signalled when a file has been read
+	uint64_t* readyFiles;
+	uint64_t readyHead;
+	uint64_t readyTail;
+	uint64_t* doneFiles;
+	uint64_t doneHead;
+	uint64_t doneTail;
+	uint32_t finished;          // set once every file has been transformed
+	struct batchFile* files;
+	char** inputs;
+	batchTransform transform;
+	int event;                  // eventfd the workers bump when they finish a file
+} queues;
+
+static uint32_t ringOpen(
+    struct ring* ring,
+    uint32_t entries
+) {
+	memset(ring, 0, sizeof * ring);
+	ring->entries = entries;
+	struct io_uring_params params;
+	memset(&params, 0, sizeof params);
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd >= 0) {
+		ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP && ring->cqRingSize > ring->sqRingSize) {
+			ring->sqRingSize = ring->cqRingSize;
+		}
+		ring->sqRing = mmap(
+		    0, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING
+		);
+		ring->cqRing = ring->sqRing;
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP) && ring->sqRing != MAP_FAILED) {
+			ring->cqRing = mmap(
+			    0, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING
+			);
+		}
+		ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+		ring->sqes = mmap(
+		    0, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES
+		);
+		if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+			close(ring->fd);
+			ring->fd = -1;
+		}
+	}
+	if (ring->fd < 0) {
+		ring->fallback = malloc(entries * sizeof * ring->fallback);
+		assert(ring->fallback);
+		return 1;
+	}
+	uint8_t* sq = ring->sqRing;
+	uint8_t* cq = ring->cqRing;
+	ring->sqTail = (uint32_t*)(sq + params.sq_off.tail);
+	ring->sqMask = (uint32_t*)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (uint32_t*)(sq + params.sq_off.array);
+	ring->cqHead = (uint32_t*)(cq + params.cq_off.head);
+	ring->cqTail = (uint32_t*)(cq + params.cq_off.tail);
+	ring->cqMask = (uint32_t*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	return 0;
+}
+
+static void ringClose(
+    struct ring* ring
+) {
+	if (ring->fd < 0) {
+		free(ring->fallback);
+		return;
+	}
+	munmap(ring->sqes, ring->sqesSize);
+	if (ring->cqRing != ring->sqRing) {
+		munmap(ring->cqRing, ring->cqRingSize);
+	}
+	munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+}
+
+// Start a read or write of length bytes at offset, tagged for ringWait:
+//  The caller keeps no more than entries operations outstanding.
+static void ringSubmit(
+    struct ring* ring,
+    uint32_t opcode,
+    int fd,
+    void* buffer,
+    uint64_t length,
+    uint64_t offset,
+    uint64_t tag
+) {
+	// Single operations are capped well below 2 GiB; longer files take several.
+	if (length > 1 << 30) {
+		length = 1 << 30;
+	}
+	if (ring->fd < 0) {
+		struct io_uring_cqe* completion = &ring->fallback[(ring->fallbackHead + ring->fallbackCount++) % ring->entries];
+		ssize_t result;
+		do {
+			if (opcode == IORING_OP_READ) {
+				result = offset == UINT64_MAX ? read(fd, buffer, length) : pread(fd, buffer, length, offset);
+			} else {
+				result = pwrite(fd, buffer, length, offset);
+			}
+		} while (result < 0 && errno == EINTR);
+		completion->user_data = tag;
+		completion->res = result < 0 ? -errno : result;
+		return;
+	}
+	uint32_t tail = *ring->sqTail;
+	uint32_t index = tail & *ring->sqMask;
+	struct io_uring_sqe* entry = &ring->sqes[index];
+	memset(entry, 0, sizeof * entry);
+	entry->opcode = opcode;
+	entry->fd = fd;
+	entry->addr = (uint64_t)(uintptr_t) buffer;
+	entry->len = length;
+	// An offset of -1 reads at the file position, which is what an eventfd needs.
+	entry->off = offset;
+	entry->user_data = tag;
+	ring->sqArray[index] = index;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, 0, 0) < 0 && errno == EINTR);
+}
+
+// Wait for the next operation to complete:
+static void ringWait(
+    struct ring* ring,
+    uint64_t* tag,
+    int32_t* result
+) {
+	if (ring->fd < 0) {
+		assert(ring->fallbackCount);
+		struct io_uring_cqe* completion = &ring->fallback[ring->fallbackHead];
+		ring->fallbackHead = (ring->fallbackHead + 1) % ring->entries;
+		ring->fallbackCount--;
+		*tag = completion->user_data;
+		*result = completion->res;
+		return;
+	}
+	uint32_t head = *ring->cqHead;
+	while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+		syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0);
+	}
+	struct io_uring_cqe* completion = &ring->cqes[head & *ring->cqMask];
+	*tag = completion->user_data;
+	*result = completion->res;
+	__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+}
+
+static void* workerThread(
+    void* argument
+) {
+	(void) argument;
+	pthread_mutex_lock(&queues.lock);
+	while (1) {
+		while (queues.readyHead == queues.readyTail && !queues.finished) {
+			pthread_cond_wait(&queues.ready, &queues.lock);
+		}
+		if (queues.readyHead == queues.readyTail) {
+			break;
+		}
+		uint64_t k = queues.readyFiles[queues.readyHead++];
+		pthread_mutex_unlock(&queues.lock);
+		struct batchFile* file = &queues.files[k];
+		uint64_t resultLength = 0;
+		uint8_t* result = queues.transform(file->data, file->length, &resultLength, queues.inputs[k]);
+		free(file->data);
+		file->data = result;
+		file->length = result ? resultLength : 0;
+		pthread_mutex_lock(&queues.lock);
+		queues.doneFiles[queues.doneTail++] = k;
+		uint64_t one = 1;
+		if (write(queues.event, &one, sizeof one) != sizeof one) {
+			printf("Failed to signal the I/O thread.\n");
+			exit(1);
+		}
+	}
+	pthread_mutex_unlock(&queues.lock);
+	intClearPool();
+	return 0;
+}
+
+// Open a file and start reading all of it:
+//  Returns 0 on success, or 1 if it couldn't be opened.
+static uint32_t startRead(
+    struct ring* ring,
+    uint64_t k,
+    const char* path
+) {
+	struct batchFile* file = &queues.files[k];
+	struct stat status;
+	file->fd = open(path, O_RDONLY);
+	if (file->fd < 0 || fstat(file->fd, &status) || !S_ISREG(status.st_mode)) {
+		printf("Couldn't read %s.\n", path);
+		if (file->fd >= 0) {
+			close(file->fd);
+		}
+		return 1;
+	}
+	file->stage = STAGE_READ;
+	file->length = status.st_size;
+	file->done = 0;
+	file->data = malloc(file->length + 1);
+	assert(file->data);
+	if (file->length == 0) {
+		// Nothing to read; go straight to the workers.
+		close(file->fd);
+		file->stage = STAGE_TRANSFORM;
+		pthread_mutex_lock(&queues.lock);
+		queues.readyFiles[queues.readyTail++] = k;
+		pthread_cond_signal(&queues.ready);
+		pthread_mutex_unlock(&queues.lock);
+		return 0;
+	}
+	ringSubmit(ring, IORING_OP_READ, file->fd, file->data, file->length, 0, k);
+	return 0;
+}
+
+// Build the list of files for a batch:
+uint32_t batchList(
+    const char* source,
+    const char* destination,
+    char*** inputs,
+    char*** outputs,
+    uint64_t* count
+) {
+	uint64_t capacity = 64;
+	*inputs = malloc(capacity * sizeof ** inputs);
+	*count = 0;
+	struct stat status;
+	if (stat(source, &status)) {
+		free(*inputs);
+		return 1;
+	}
+	if (S_ISDIR(status.st_mode)) {
+		DIR* directory = opendir(source);
+		if (!directory) {
+			free(*inputs);
+			return 1;
+		}
+		struct dirent* entry;
+		while ((entry = readdir(directory))) {
+			char* path;
+			if (asprintf(&path, "%s/%s", source, entry->d_name) < 0) {
+				continue;
+			}
+			if (stat(path, &status) || !S_ISREG(status.st_mode)) {
+				free(path);
+				continue;
+			}
+			if (*count == capacity) {
+				capacity *= 2;
+				*inputs = realloc(*inputs, capacity * sizeof ** inputs);
+			}
+			(*inputs)[(*count)++] = path;
+		}
+		closedir(directory);
+	} else {
+		FILE* manifest = fopen(source, "r");
+		if (!manifest) {
+			free(*inputs);
+			return 1;
+		}
+		char* line = 0;
+		size_t lineSize = 0;
+		ssize_t got;
+		while ((got = getline(&line, &lineSize, manifest)) > 0) {
+			while (got && (line[got - 1] == '\n' || line[got - 1] == '\r')) {
+				line[--got] = 0;
+			}
+			if (got == 0) {
+				continue;
+			}
+			if (*count == capacity) {
+				capacity *= 2;
+				*inputs = realloc(*inputs, capacity * sizeof ** inputs);
+			}
+			(*inputs)[(*count)++] = strdup(line);
+		}
+		free(line);
+		fclose(manifest);
+	}
+	*outputs = malloc((*count + 1) * sizeof ** outputs);
+	uint64_t k;
+	for (k = 0; k < *count; k++) {
+		const char* name = strrchr((*inputs)[k], '/');
+		name = name ? name + 1 : (*inputs)[k];
+		if (asprintf(&(*outputs)[k], "%s/%s", destination, name) < 0) {
+			(*outputs)[k] = 0;
+		}
+	}
+	return 0;
+}
+
+// Free the lists made by batchList:
+void batchFreeList(
+    char** inputs,
+    char** outputs,
+    uint64_t count
+) {
+	uint64_t k;
+	for (k = 0; k < count; k++) {
+		free(inputs[k]);
+		free(outputs[k]);
+	}
+	free(inputs);
+	free(outputs);
+}
+
+// Transform every input into its output:
+//  This thread keeps up to WINDOW_PER_WORKER files per worker in flight. It reads them through the ring,
+//  hands them to the workers, and writes their results back through the ring, so the I/O of some files
+//  overlaps the exponentiation of others.
+uint64_t batchRun(
+    char** inputs,
+    char** outputs,
+    uint64_t count,
+    uint32_t workers,
+    batchTransform transform
+) {
+	uint64_t window = (uint64_t) WINDOW_PER_WORKER * workers;
+	struct ring ring;
+	// One operation per file in the window, and one for the eventfd:
+	ringOpen(&ring, window + 1);
+	memset(&queues, 0, sizeof queues);
+	pthread_mutex_init(&queues.lock, 0);
+	pthread_cond_init(&queues.ready, 0);
+	queues.readyFiles = malloc((count + 1) * sizeof * queues.readyFiles);
+	queues.doneFiles = malloc((count + 1) * sizeof * queues.doneFiles);
+	queues.files = calloc(count + 1, sizeof * queues.files);
+	queues.inputs = inputs;
+	queues.transform = transform;
+	queues.event = eventfd(0, 0);
+	if (queues.event < 0) {
+		printf("Couldn't create an eventfd.\n");
+		exit(1);
+	}
+	pthread_t* threads = malloc(workers * sizeof * threads);
+	uint32_t j;
+	for (j = 0; j < workers; j++) {
+		pthread_create(&threads[j], 0, workerThread, 0);
+	}
+	uint64_t next = 0;
+	uint64_t finished = 0;
+	uint64_t active = 0;
+	uint64_t transforming = 0;
+	uint64_t failures = 0;
+	uint64_t eventValue;
+	uint32_t eventPending = 0;
+	while (finished < count) {
+		// Keep the window full:
+		while (active < window && next < count) {
+			if (startRead(&ring, next, inputs[next])) {
+				failures++;
+				finished++;
+			} else {
+				active++;
+				if (queues.files[next].stage == STAGE_TRANSFORM) {
+					transforming++;
+				}
+			}
+			next++;
+		}
+		// Start writing whatever the workers have finished:
+		pthread_mutex_lock(&queues.lock);
+		uint64_t doneTail = queues.doneTail;
+		pthread_mutex_unlock(&queues.lock);
+		while (queues.doneHead < doneTail) {
+			uint64_t k = queues.doneFiles[queues.doneHead++];
+			struct batchFile* file = &queues.files[k];
+			transforming--;
+			file->fd = -1;
+			if (file->data && outputs[k]) {
+				file->fd = open(outputs[k], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if (file->fd < 0) {
+					printf("Couldn't write %s.\n", outputs[k]);
+				}
+			}
+			if (file->fd < 0) {
+				free(file->data);
+				failures++;
+				finished++;
+				active--;
+				continue;
+			}
+			file->stage = STAGE_WRITE;
+			file->done = 0;
+			if (file->length == 0) {
+				close(file->fd);
+				free(file->data);
+				finished++;
+				active--;
+				continue;
+			}
+			ringSubmit(&ring, IORING_OP_WRITE, file->fd, file->data, file->length, 0, k);
+		}
+		if (finished == count || (active < window && next < count)) {
+			continue;
+		}
+		// Nothing more can start until something completes; make sure a worker finishing counts.
+		//  Without io_uring the eventfd read blocks right here, so hand back completions already queued first:
+		if (transforming && !eventPending && !(ring.fd < 0 && ring.fallbackCount)) {
+			ringSubmit(&ring, IORING_OP_READ, queues.event, &eventValue, sizeof eventValue, UINT64_MAX, WORKER_EVENT);
+			eventPending = 1;
+		}
+		uint64_t tag;
+		int32_t result;
+		ringWait(&ring, &tag, &result);
+		if (tag == WORKER_EVENT) {
+			eventPending = 0;
+			continue;
+		}
+		struct batchFile* file = &queues.files[tag];
+		const char* path = file->stage == STAGE_READ ? inputs[tag] : outputs[tag];
+		if (result <= 0) {
+			// A file that shrinks while being read fails too, rather than be transformed half-read.
+			printf("Couldn't %s %s.\n", file->stage == STAGE_READ ? "read" : "write", path);
+			close(file->fd);
+			free(file->data);
+			failures++;
+			finished++;
+			active--;
+			continue;
+		}
+		file->done += result;
+		if (file->done < file->length) {
+			uint32_t opcode = file->stage == STAGE_READ ? IORING_OP_READ : IORING_OP_WRITE;
+			ringSubmit(
+			    &ring, opcode, file->fd, file->data + file->done, file->length - file->done, file->done, tag
+			);
+			continue;
+		}
+		close(file->fd);
+		if (file->stage == STAGE_READ) {
+			file->stage = STAGE_TRANSFORM;
+			transforming++;
+			pthread_mutex_lock(&queues.lock);
+			queues.readyFiles[queues.readyTail++] = tag;
+			pthread_cond_signal(&queues.ready);
+			pthread_mutex_unlock(&queues.lock);
+		} else {
+			free(file->data);
+			finished++;
+			active--;
+		}
+	}
+	pthread_mutex_lock(&queues.lock);
+	queues.finished = 1;
+	pthread_cond_broadcast(&queues.ready);
+	pthread_mutex_unlock(&queues.lock);
+	for (j = 0; j < workers; j++) {
+		pthread_join(threads[j], 0);
+	}
+	if (eventPending) {
+		// The ring still has a read waiting on the eventfd; wake it so the ring can be torn down.
+		eventValue = 1;
+		if (write(queues.event, &eventValue, sizeof eventValue) == sizeof eventValue) {
+			uint64_t tag;
+			int32_t result;
+			ringWait(&ring, &tag, &result);
+		}
+	}
+	close(queues.event);
+	ringClose(&ring);
+	free(threads);
+	free(queues.readyFiles);
+	free(queues.doneFiles);
+	free(queues.files);
+	return failures;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+// batchFiles.h
+// Runs one transformation over many files: the calling thread reads and writes them through io_uring,
+//  falling back to plain pread/pwrite, while worker threads transform the files already read.
+
+// Transform one file's contents into a newly allocated buffer:
+//  Returns 0 on failure, after printing why.
+typedef uint8_t* (*batchTransform)(
+    const uint8_t* data,        // contents of the input file
+    uint64_t length,            // size of the input file
+    uint64_t* resultLength,     // receives the size of the output
+    const char* path            // input path, for messages
+);
+
+// Build the list of files for a batch:
+//  source is either a directory, all of whose regular files are taken, or a manifest naming one input per line.
+//  Each output is destination/basename(input). Returns 0 on success, or 1 if source can't be read.
+uint32_t batchList(
+    const char* source,         // directory or manifest
+    const char* destination,    // directory for the outputs
+    char*** inputs,             // receives a new array of input paths
+    char*** outputs,            // receives a new array of output paths
+    uint64_t* count             // receives the number of files
+);
+
+// Free the lists made by batchList:
+void batchFreeList(
+    char** inputs,
+    char** outputs,
+    uint64_t count
+);
+
+// Transform every input into its output:
+//  Returns the number of files that failed.
+uint64_t batchRun(
+    char** inputs,
+    char** outputs,
+    uint64_t count,
+    uint32_t workers,           // number of transforming threads, at least one
+    batchTransform transform
+);
@@ -0,0 +1,351 @@
+#include <string.h>
+#include <assert.h>
+
+#include "chacha.h"
+
+// chacha.c
+// ChaCha20 stream cipher and its Poly1305 authenticated construction (RFC 8439).
+
+#define ROTATE(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d) \
+	a += b; d ^= a; d = ROTATE(d, 16); \
+	c += d; b ^= c; b = ROTATE(b, 12); \
+	a += b; d ^= a; d = ROTATE(d, 8); \
+	c += d; b ^= c; b = ROTATE(b, 7);
+
+// Load a little-endian 32-bit word:
+static uint32_t getWord(
+    const uint8_t* buffer
+) {
+	return (uint32_t) buffer[0] | (uint32_t) buffer[1] << 8 | (uint32_t) buffer[2] << 16 | (uint32_t) buffer[3] << 24;
+}
+
+// Store a little-endian 32-bit word:
+static void putWord(
+    uint8_t* buffer,
+    uint32_t word
+) {
+	buffer[0] = (uint8_t) word;
+	buffer[1] = (uint8_t)(word >> 8);
+	buffer[2] = (uint8_t)(word >> 16);
+	buffer[3] = (uint8_t)(word >> 24);
+}
+
+// Produce the next 64 bytes of keystream and advance the block counter:
+static void chachaBlock(
+    struct chacha* cipher
+) {
+	uint32_t x[16];
+	memcpy(x, cipher->state, sizeof x);
+	uint32_t round = 10;
+	while (round--) {
+		// Column rounds:
+		QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		// Diagonal rounds:
+		QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+	}
+	uint32_t j;
+	for (j = 0; j < 16; j++) {
+		putWord(cipher->keystream + 4 * j, x[j] + cipher->state[j]);
+	}
+	cipher->state[12]++;
+	cipher->used = 0;
+}
+
+// Start a keystream from a 256-bit key, a 96-bit nonce and an initial block counter:
+void chachaInit(
+    struct chacha* cipher,
+    const uint8_t* key,
+    const uint8_t* nonce,
+    uint32_t counter
+) {
+	// "expand 32-byte k"
+	cipher->state[0] = 0x61707865;
+	cipher->state[1] = 0x3320646E;
+	cipher->state[2] = 0x79622D32;
+	cipher->state[3] = 0x6B206574;
+	uint32_t j;
+	for (j = 0; j < 8; j++) {
+		cipher->state[4 + j] = getWord(key + 4 * j);
+	}
+	cipher->state[12] = counter;
+	for (j = 0; j < 3; j++) {
+		cipher->state[13 + j] = getWord(nonce + 4 * j);
+	}
+	// No keystream is buffered yet:
+	cipher->used = 64;
+	cipher->remaining = (((uint64_t) 1 << 32) - counter) << 6;
+} // O(1)
+
+// XOR the next length bytes of keystream into a buffer:
+uint32_t chachaXor(
+    struct chacha* cipher,
+    uint8_t* out,
+    const uint8_t* in,
+    uint64_t length
+) {
+	assert(out && in);
+	// The block after the last would reuse the keystream of block 0:
+	if (length > cipher->remaining) {
+		return 1;
+	}
+	cipher->remaining -= length;
+	while (length) {
+		if (cipher->used == 64) {
+			chachaBlock(cipher);
+		}
+		uint64_t n = 64 - cipher->used;
+		if (n > length) {
+			n = length;
+		}
+		const uint8_t* keystream = cipher->keystream + cipher->used;
+		uint64_t j;
+		for (j = 0; j < n; j++) {
+			out[j] = in[j] ^ keystream[j];
+		}
+		cipher->used += n;
+		out += n;
+		in += n;
+		length -= n;
+	}
+	return 0;
+} // O(length)
+
+// Start a Poly1305 authenticator from a 256-bit one-time key:
+static void poly1305Init(
+    struct poly1305* mac,
+    const uint8_t* key
+) {
+	// Clamp r, as the algorithm requires, while splitting it into 26-bit limbs:
+	mac->r[0] = getWord(key) & 0x3FFFFFF;
+	mac->r[1] = (getWord(key + 3) >> 2) & 0x3FFFF03;
+	mac->r[2] = (getWord(key + 6) >> 4) & 0x3FFC0FF;
+	mac->r[3] = (getWord(key + 9) >> 6) & 0x3F03FFF;
+	mac->r[4] = (getWord(key + 12) >> 8) & 0x00FFFFF;
+	uint32_t j;
+	for (j = 0; j < 5; j++) {
+		mac->h[j] = 0;
+	}
+	for (j = 0; j < 4; j++) {
+		mac->pad[j] = getWord(key + 16 + 4 * j);
+	}
+	mac->used = 0;
+} // O(1)
+
+// Fold 16-byte blocks into the accumulator: h = (h + block) * r mod 2^130 - 5:
+//  hibit is 2^128 in the top limb for full blocks, or 0 for the final partial block, which carries its own 1 byte.
+static void poly1305Blocks(
+    struct poly1305* mac,
+    const uint8_t* data,
+    uint64_t length,
+    uint32_t hibit
+) {
+	const uint32_t mask = 0x3FFFFFF;
+	uint32_t r0 = mac->r[0], r1 = mac->r[1], r2 = mac->r[2], r3 = mac->r[3], r4 = mac->r[4];
+	// 2^130 is 5 mod the prime, so limbs that overflow the top come back in times 5:
+	uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32_t h0 = mac->h[0], h1 = mac->h[1], h2 = mac->h[2], h3 = mac->h[3], h4 = mac->h[4];
+	while (length >= 16) {
+		h0 += getWord(data) & mask;
+		h1 += (getWord(data + 3) >> 2) & mask;
+		h2 += (getWord(data + 6) >> 4) & mask;
+		h3 += (getWord(data + 9) >> 6) & mask;
+		h4 += (getWord(data + 12) >> 8) | hibit;
+		uint64_t d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 + (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+		uint64_t d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 + (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+		uint64_t d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 + (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+		uint64_t d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 + (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+		uint64_t d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 + (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+		// Partially reduce, leaving each limb a little over 26 bits at most:
+		d1 += d0 >> 26;
+		h0 = (uint32_t) d0 & mask;
+		d2 += d1 >> 26;
+		h1 = (uint32_t) d1 & mask;
+		d3 += d2 >> 26;
+		h2 = (uint32_t) d2 & mask;
+		d4 += d3 >> 26;
+		h3 = (uint32_t) d3 & mask;
+		h0 += (uint32_t)(d4 >> 26) * 5;
+		h4 = (uint32_t) d4 & mask;
+		h1 += h0 >> 26;
+		h0 &= mask;
+		data += 16;
+		length -= 16;
+	}
+	mac->h[0] = h0;
+	mac->h[1] = h1;
+	mac->h[2] = h2;
+	mac->h[3] = h3;
+	mac->h[4] = h4;
+} // O(length)
+
+// Authenticate the next length bytes of a message:
+static void poly1305Update(
+    struct poly1305* mac,
+    const uint8_t* data,
+    uint64_t length
+) {
+	if (mac->used) {
+		uint64_t n = 16 - mac->used;
+		if (n > length) {
+			n = length;
+		}
+		memcpy(mac->buffer + mac->used, data, n);
+		mac->used += n;
+		data += n;
+		length -= n;
+		if (mac->used < 16) {
+			return;
+		}
+		poly1305Blocks(mac, mac->buffer, 16, 1 << 24);
+		mac->used = 0;
+	}
+	uint64_t whole = length & ~(uint64_t) 15;
+	poly1305Blocks(mac, data, whole, 1 << 24);
+	memcpy(mac->buffer, data + whole, length - whole);
+	mac->used = length - whole;
+} // O(length)
+
+// Authenticate zeroes up to the next multiple of 16 bytes, as the construction pads each part of a message:
+static void poly1305Pad(
+    struct poly1305* mac
+) {
+	static const uint8_t zeroes[16];
+	if (mac->used) {
+		poly1305Update(mac, zeroes, 16 - mac->used);
+	}
+} // O(1)
+
+// Write the tag of a message and spend the authenticator:
+static void poly1305Finish(
+    struct poly1305* mac,
+    uint8_t* tag
+) {
+	const uint32_t mask = 0x3FFFFFF;
+	if (mac->used) {
+		mac->buffer[mac->used] = 1;
+		memset(mac->buffer + mac->used + 1, 0, 15 - mac->used);
+		poly1305Blocks(mac, mac->buffer, 16, 0);
+	}
+	uint32_t h0 = mac->h[0], h1 = mac->h[1], h2 = mac->h[2], h3 = mac->h[3], h4 = mac->h[4];
+	// Carry fully:
+	h2 += h1 >> 26;
+	h1 &= mask;
+	h3 += h2 >> 26;
+	h2 &= mask;
+	h4 += h3 >> 26;
+	h3 &= mask;
+	h0 += (h4 >> 26) * 5;
+	h4 &= mask;
+	h1 += h0 >> 26;
+	h0 &= mask;
+	// h is now below 2 (2^130 - 5); subtract the prime once if that doesn't go negative, without branching:
+	uint32_t g0 = h0 + 5;
+	uint32_t g1 = h1 + (g0 >> 26);
+	g0 &= mask;
+	uint32_t g2 = h2 + (g1 >> 26);
+	g1 &= mask;
+	uint32_t g3 = h3 + (g2 >> 26);
+	g2 &= mask;
+	uint32_t g4 = h4 + (g3 >> 26) - (1 << 26);
+	g3 &= mask;
+	uint32_t select = (g4 >> 31) - 1;
+	h0 = (h0 & ~select) | (g0 & select);
+	h1 = (h1 & ~select) | (g1 & select);
+	h2 = (h2 & ~select) | (g2 & select);
+	h3 = (h3 & ~select) | (g3 & select);
+	h4 = (h4 & ~select) | (g4 & select);
+	// Repack into 32-bit words and add the pad mod 2^128:
+	uint32_t words[4] = {
+		h0 | h1 << 26, h1 >> 6 | h2 << 20, h2 >> 12 | h3 << 14, h3 >> 18 | h4 << 8
+	};
+	uint64_t carry = 0;
+	uint32_t j;
+	for (j = 0; j < 4; j++) {
+		carry += (uint64_t) words[j] + mac->pad[j];
+		putWord(tag + 4 * j, (uint32_t) carry);
+		carry >>= 32;
+	}
+	memset(mac, 0, sizeof * mac);
+} // O(1)
+
+// Start a ChaCha20-Poly1305 message:
+void chachaSealInit(
+    struct chachaSeal* seal,
+    const uint8_t* key,
+    const uint8_t* nonce,
+    const uint8_t* aad,
+    uint64_t aadLength
+) {
+	// The Poly1305 key is the first half of keystream block 0:
+	chachaInit(&seal->cipher, key, nonce, 0);
+	chachaBlock(&seal->cipher);
+	poly1305Init(&seal->mac, seal->cipher.keystream);
+	chachaInit(&seal->cipher, key, nonce, 1);
+	poly1305Update(&seal->mac, aad, aadLength);
+	poly1305Pad(&seal->mac);
+	seal->aadLength = aadLength;
+	seal->length = 0;
+} // O(aadLength)
+
+// Encrypt the next length bytes of the message and authenticate the ciphertext:
+uint32_t chachaSealEncrypt(
+    struct chachaSeal* seal,
+    uint8_t* out,
+    const uint8_t* in,
+    uint64_t length
+) {
+	if (chachaXor(&seal->cipher, out, in, length)) {
+		return 1;
+	}
+	chachaSealAuthenticate(seal, out, length);
+	return 0;
+} // O(length)
+
+// Authenticate the next length bytes of ciphertext without decrypting them:
+void chachaSealAuthenticate(
+    struct chachaSeal* seal,
+    const uint8_t* cipher,
+    uint64_t length
+) {
+	poly1305Update(&seal->mac, cipher, length);
+	seal->length += length;
+} // O(length)
+
+// Write the tag of everything authenticated so far:
+void chachaSealFinish(
+    struct chachaSeal* seal,
+    uint8_t* tag
+) {
+	// The tag covers the padded ciphertext, then the lengths of both parts:
+	poly1305Pad(&seal->mac);
+	uint8_t lengths[16];
+	putWord(lengths, (uint32_t) seal->aadLength);
+	putWord(lengths + 4, (uint32_t)(seal->aadLength >> 32));
+	putWord(lengths + 8, (uint32_t) seal->length);
+	putWord(lengths + 12, (uint32_t)(seal->length >> 32));
+	poly1305Update(&seal->mac, lengths, sizeof lengths);
+	poly1305Finish(&seal->mac, tag);
+} // O(1)
+
+// Check a received tag against everything authenticated so far:
+uint32_t chachaSealCheck(
+    struct chachaSeal* seal,
+    const uint8_t* tag
+) {
+	uint8_t expected[CHACHA_TAG_SIZE];
+	chachaSealFinish(seal, expected);
+	uint8_t difference = 0;
+	uint32_t j;
+	for (j = 0; j < CHACHA_TAG_SIZE; j++) {
+		difference |= expected[j] ^ tag[j];
+	}
+	return difference != 0;
+} // O(1)
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+
+// chacha.h
+// ChaCha20 stream cipher and its Poly1305 authenticated construction (RFC 8439).
+
+#define CHACHA_KEY_SIZE 32
+#define CHACHA_NONCE_SIZE 12
+#define CHACHA_TAG_SIZE 16
+
+// State of a ChaCha20 keystream:
+struct chacha {
+	uint32_t state[16];
+	uint8_t keystream[64];
+	uint32_t used;      // bytes of keystream already consumed
+	uint64_t remaining; // bytes of keystream left before the 32-bit block counter would wrap
+};
+
+// State of a Poly1305 authenticator:
+struct poly1305 {
+	uint32_t r[5];      // clamped key, in 26-bit limbs
+	uint32_t h[5];      // accumulator, in 26-bit limbs
+	uint32_t pad[4];    // key half added to the final accumulator
+	uint8_t buffer[16];
+	uint32_t used;      // bytes waiting in buffer
+};
+
+// State of a ChaCha20-Poly1305 message:
+//  The keystream starts at block 1, block 0 having been spent on the Poly1305 key.
+struct chachaSeal {
+	struct chacha cipher;
+	struct poly1305 mac;
+	uint64_t aadLength;     // bytes of associated data
+	uint64_t length;        // bytes of ciphertext authenticated so far
+};
+
+// Start a keystream from a 256-bit key, a 96-bit nonce and an initial block counter:
+void chachaInit(
+    struct chacha* cipher,  // state to initialize
+    const uint8_t* key,     // CHACHA_KEY_SIZE bytes
+    const uint8_t* nonce,   // CHACHA_NONCE_SIZE bytes
+    uint32_t counter        // first block number, usually zero
+); // O(1)
+
+// XOR the next length bytes of keystream into a buffer:
+//  Encryption and decryption are the same operation; in and out may be the same buffer.
+//  Returns 0 on success, or 1, having done nothing, if the keystream would run past its last block.
+uint32_t chachaXor(
+    struct chacha* cipher,  // keystream to draw from
+    uint8_t* out,           // buffer to receive the result
+    const uint8_t* in,      // buffer to be encrypted or decrypted
+    uint64_t length         // number of bytes to process
+); // O(length)
+
+// Start a ChaCha20-Poly1305 message, authenticating the associated data that travels with it in the clear:
+void chachaSealInit(
+    struct chachaSeal* seal,    // state to initialize
+    const uint8_t* key,         // CHACHA_KEY_SIZE bytes
+    const uint8_t* nonce,       // CHACHA_NONCE_SIZE bytes
+    const uint8_t* aad,         // associated data
+    uint64_t aadLength          // bytes of associated data
+); // O(aadLength)
+
+// Encrypt the next length bytes of the message and authenticate the ciphertext:
+//  in and out may be the same buffer. Returns 0 on success, or 1, having done nothing, if the message would
+//  outgrow the keystream.
+uint32_t chachaSealEncrypt(
+    struct chachaSeal* seal,    // message to extend
+    uint8_t* out,               // buffer to receive the ciphertext
+    const uint8_t* in,          // plaintext
+    uint64_t length             // number of bytes to process
+); // O(length)
+
+// Authenticate the next length bytes of ciphertext without decrypting them:
+//  Decryption authenticates the whole ciphertext and checks the tag first, then decrypts it with chachaXor on
+//  seal->cipher, so no plaintext is released from a message that was tampered with.
+void chachaSealAuthenticate(
+    struct chachaSeal* seal,    // message to extend
+    const uint8_t* cipher,      // ciphertext
+    uint64_t length             // number of bytes of ciphertext
+); // O(length)
+
+// Write the tag of everything authenticated so far:
+void chachaSealFinish(
+    struct chachaSeal* seal,    // message to finish
+    uint8_t* tag                // receives CHACHA_TAG_SIZE bytes
+); // O(1)
+
+// Check a received tag against everything authenticated so far, in constant time:
+//  Returns 0 if it matches, or 1 if it doesn't.
+uint32_t chachaSealCheck(
+    struct chachaSeal* seal,    // message to check
+    const uint8_t* tag          // CHACHA_TAG_SIZE bytes received with it
+); // O(1)
@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cipherText.h"
+
+// cipherText.c
+// Binary ciphertext container.
+
+// Store an integer as n little-endian bytes:
+static void putLittle(
+    uint8_t* buffer,
+    uint64_t value,
+    uint32_t n
+) {
+	while (n--) {
+		*(buffer++) = (uint8_t) value;
+		value >>= 8;
+	}
+}
+
+// Load an integer from n little-endian bytes:
+static uint64_t getLittle(
+    const uint8_t* buffer,
+    uint32_t n
+) {
+	uint64_t value = 0;
+	while (n--) {
+		value <<= 8;
+		value += buffer[n];
+	}
+	return value;
+}
+
+// Return the number of limbs needed to store any number below 2^keySize:
+uint64_t cipherLimbs(
+    uint64_t keySize
+) {
+	return (keySize + 63) / 64;
+} // O(1)
+
+// Return the number of plaintext bytes cipherPackBlock fits into a block for a key:
+uint64_t cipherCapacity(
+    uint64_t keySize
+) {
+	assert(keySize > 8 * (CIPHER_FRAME_SIZE + 1));
+	uint64_t capacity = (keySize - 1) / 8 - CIPHER_FRAME_SIZE;
+	// The length has to fit in the 16-bit frame:
+	return capacity > 0xFFFF ? 0xFFFF : capacity;
+} // O(1)
+
+// Pack up to cipherCapacity(keySize) bytes of arbitrary data into a new intChain:
+//  Big-endian layout: the 16-bit length, then the data, then zero padding.
+//  Since the length is at least one, a packed block is never zero.
+struct intChain* cipherPackBlock(
+    const uint8_t* data,
+    uint64_t length,
+    uint64_t keySize
+) {
+	uint64_t capacity = cipherCapacity(keySize);
+	assert(length > 0 && length <= capacity);
+	uint8_t* buffer = calloc(CIPHER_FRAME_SIZE + capacity, 1);
+	assert(buffer);
+	buffer[0] = (uint8_t)(length >> 8);
+	buffer[1] = (uint8_t) length;
+	memcpy(buffer + CIPHER_FRAME_SIZE, data, length);
+	struct intChain* X = intFromBytes(buffer, CIPHER_FRAME_SIZE + capacity);
+	free(buffer);
+	return X;
+} // O(keySize)
+
+// Unpack a block made by cipherPackBlock into a buffer of cipherCapacity(keySize) bytes:
+uint64_t cipherUnpackBlock(
+    struct intChain* X,
+    uint8_t* data,
+    uint64_t keySize
+) {
+	uint64_t capacity = cipherCapacity(keySize);
+	uint8_t* buffer = malloc(CIPHER_FRAME_SIZE + capacity);
+	assert(buffer);
+	uint64_t length = UINT64_MAX;
+	if (!intToBytes(X, buffer, CIPHER_FRAME_SIZE + capacity)) {
+		length = ((uint64_t) buffer[0] << 8) + buffer[1];
+		if (length == 0 || length > capacity) {
+			length = UINT64_MAX;
+		} else {
+			memcpy(data, buffer + CIPHER_FRAME_SIZE, length);
+		}
+	}
+	free(buffer);
+	return length;
+} // O(keySize)
+
+// Store a container header in a buffer of CIPHER_HEADER_SIZE bytes:
+void cipherPutHeader(
+    uint8_t* buffer,
+    struct cipherHeader* header
+) {
+	memset(buffer, 0, CIPHER_HEADER_SIZE);
+	memcpy(buffer, CIPHER_MAGIC, 4);
+	putLittle(buffer + 4, header->version, 2);
+	putLittle(buffer + 6, header->flags, 2);
+	putLittle(buffer + 8, header->keySize, 4);
+	putLittle(buffer + 12, header->limbs, 4);
+	putLittle(buffer + 16, header->keyId, 8);
+}
+
+// Store one ciphertext block in a buffer of 16 * limbs bytes:
+uint32_t cipherPutBlock(
+    uint8_t* buffer,
+    uint64_t limbs,
+    struct intChain* ScrambleCipher,
+    struct intChain* WordCipher
+) {
+	return intToLimbs(ScrambleCipher, buffer, limbs) || intToLimbs(WordCipher, buffer + 8 * limbs, limbs);
+}
+
+// Write a container header to a file:
+uint32_t cipherWriteHeader(
+    FILE* fp,
+    struct cipherHeader* header
+) {
+	uint8_t buffer[CIPHER_HEADER_SIZE];
+	cipherPutHeader(buffer, header);
+	return fwrite(buffer, CIPHER_HEADER_SIZE, 1, fp) != 1;
+}
+
+// Write one ciphertext block to a file:
+uint32_t cipherWriteBlock(
+    FILE* fp,
+    struct cipherHeader* header,
+    struct intChain* ScrambleCipher,
+    struct intChain* WordCipher
+) {
+	uint64_t recordSize = 16 * header->limbs;
+	uint8_t* buffer = malloc(recordSize);
+	assert(buffer);
+	uint32_t status = 0;
+	if (cipherPutBlock(buffer, header->limbs, ScrambleCipher, WordCipher)) {
+		status = 1;
+	} else if (fwrite(buffer, recordSize, 1, fp) != 1) {
+		status = 2;
+	}
+	free(buffer);
+	return status;
+}
+
+// Index the numbers of a mapped hex ciphertext in one pass:
+//  Each non-empty line holds one number, and each pair of numbers makes a block.
+static void indexHex(
+    struct cipherMap* map
+) {
+	uint64_t capacity = 64;
+	uint64_t count = 0;
+	uint64_t* offsets = malloc(2 * capacity * sizeof * offsets);
+	assert(offsets);
+	const char* text = (const char*) map->data;
+	uint64_t position = 0;
+	while (position < map->length) {
+		const char* lineEnd = memchr(text + position, '\n', map->length - position);
+		uint64_t end = lineEnd ? (uint64_t)(lineEnd - text) : map->length;
+		if (end > position) {
+			if (count == capacity) {
+				capacity *= 2;
+				offsets = realloc(offsets, 2 * capacity * sizeof * offsets);
+				assert(offsets);
+			}
+			offsets[2 * count] = position;
+			offsets[2 * count + 1] = end;
+			count++;
+		}
+		position = end + 1;
+	}
+	map->hexOffsets = offsets;
+	map->blockCount = count / 2;
+	// A trailing unpaired number is ignored, as the fscanf reader always did.
+}
+
+// Map a ciphertext file into memory:
+uint32_t cipherMapOpen(
+    struct cipherMap* map,
+    const char* path
+) {
+	memset(map, 0, sizeof * map);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return 1;
+	}
+	const uint8_t* data = 0;
+	if (info.st_size > 0) {
+		void* mapping = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			close(fd);
+			return 1;
+		}
+		// Blocks are consumed front to back:
+		madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+		data = mapping;
+	}
+	close(fd);
+	// The mapping keeps its own reference to the file.
+	uint32_t status = cipherMapBuffer(map, data, info.st_size);
+	map->mapped = (data != 0);
+	if (status) {
+		cipherMapClose(map);
+	}
+	return status;
+}
+
+// Index a ciphertext that is already in memory:
+uint32_t cipherMapBuffer(
+    struct cipherMap* map,
+    const uint8_t* data,
+    uint64_t length
+) {
+	memset(map, 0, sizeof * map);
+	map->data = data;
+	map->length = length;
+	if (map->length < CIPHER_HEADER_SIZE || memcmp(map->data, CIPHER_MAGIC, 4) != 0) {
+		map->hex = 1;
+		indexHex(map);
+		return 0;
+	}
+	map->header.version = getLittle(map->data + 4, 2);
+	map->header.flags = getLittle(map->data + 6, 2);
+	map->header.keySize = getLittle(map->data + 8, 4);
+	map->header.limbs = getLittle(map->data + 12, 4);
+	map->header.keyId = getLittle(map->data + 16, 8);
+	uint64_t recordSize = 16 * map->header.limbs;
+	uint64_t bodyLength = map->length - CIPHER_HEADER_SIZE;
+	if (
+	    map->header.version != CIPHER_VERSION ||
+	    map->header.limbs != cipherLimbs(map->header.keySize) ||
+	    recordSize == 0 ||
+	    (map->header.flags & CIPHER_HYBRID ? bodyLength < recordSize + CIPHER_TAG_SIZE : bodyLength % recordSize != 0)
+	) {
+		return 2;
+	}
+	map->blocks = map->data + CIPHER_HEADER_SIZE;
+	if (map->header.flags & CIPHER_HYBRID) {
+		map->blockCount = 1;
+		map->payload = map->blocks + recordSize;
+		map->payloadLength = bodyLength - recordSize - CIPHER_TAG_SIZE;
+		map->tag = map->payload + map->payloadLength;
+	} else {
+		map->blockCount = bodyLength / recordSize;
+	}
+	return 0;
+}
+
+// Release a ciphertext view, unmapping the file if cipherMapOpen mapped it:
+void cipherMapClose(
+    struct cipherMap* map
+) {
+	if (map->mapped) {
+		munmap((void*) map->data, map->length);
+	}
+	free(map->hexOffsets);
+	memset(map, 0, sizeof * map);
+}
+
+// Read block k of a mapped ciphertext straight out of the mapping:
+void cipherMapBlock(
+    struct cipherMap* map,
+    uint64_t k,
+    struct intChain** ScrambleCipher,
+    struct intChain** WordCipher
+) {
+	assert(k < map->blockCount);
+	if (map->hex) {
+		const uint64_t* offsets = map->hexOffsets + 4 * k;
+		const char* text = (const char*) map->data;
+		*ScrambleCipher = intFromHex(text + offsets[0], offsets[1] - offsets[0]);
+		*WordCipher = intFromHex(text + offsets[2], offsets[3] - offsets[2]);
+		return;
+	}
+	uint64_t limbs = map->header.limbs;
+	const uint8_t* record = map->blocks + 16 * limbs * k;
+	*ScrambleCipher = intFromLimbs(record, limbs);
+	*WordCipher = intFromLimbs(record + 8 * limbs, limbs);
+} // O(limbs)
@@ -0,0 +1,146 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include "intChain.h"
+
+// cipherText.h
+// Binary ciphertext container.
+
+// Layout (all fields little-endian):
+//  Header, CIPHER_HEADER_SIZE bytes:
+//   "EGCT", version (16 bits), flags (16 bits), key size in bits (32 bits),
+//   limbs per number (32 bits), key id (64 bits), reserved (64 bits).
+//  Then one record per block: ScrambleCipher and WordCipher, each as exactly
+//   "limbs" 64-bit little-endian limbs.
+//  Hybrid containers hold one record, followed by the stream-encrypted payload and a CIPHER_TAG_SIZE-byte
+//   Poly1305 tag over the header, the record and the payload.
+#define CIPHER_MAGIC "EGCT"
+#define CIPHER_VERSION 1
+#define CIPHER_HEADER_SIZE 32
+
+// Header flags:
+//  CIPHER_DENSE: blocks use cipherPackBlock rather than intEncodeString.
+//  CIPHER_HYBRID: a single block carries a packed ChaCha20 session key and nonce,
+//   and the rest of the file is the ChaCha20-Poly1305 encrypted payload and its tag.
+#define CIPHER_DENSE 0x0001
+#define CIPHER_HYBRID 0x0002
+
+// Bytes of the tag that ends a hybrid container:
+#define CIPHER_TAG_SIZE 16
+
+// Bytes of framing that cipherPackBlock adds in front of the data:
+#define CIPHER_FRAME_SIZE 2
+
+// Header of a ciphertext container:
+struct cipherHeader {
+	uint32_t version;
+	uint32_t flags;
+	uint64_t keySize;
+	uint64_t limbs;
+	uint64_t keyId;
+};
+
+// Read-only view of a memory-mapped ciphertext file:
+//  Legacy hex files are mapped too; hexOffsets then holds the start and end of every number.
+struct cipherMap {
+	const uint8_t* data;
+	uint64_t length;
+	struct cipherHeader header;
+	const uint8_t* blocks;
+	uint64_t blockCount;
+	uint32_t hex;
+	uint64_t* hexOffsets;
+	const uint8_t* payload;
+	uint64_t payloadLength;
+	const uint8_t* tag;     // hybrid containers only; the header, record and payload come before it
+	uint32_t mapped;
+};
+
+// Return the number of limbs needed to store any number below 2^keySize:
+uint64_t cipherLimbs(
+    uint64_t keySize    // size of the key in bits
+); // O(1)
+
+// Return the number of plaintext bytes cipherPackBlock fits into a block for a key:
+//  The packed block stays below 2^(keySize-1), and so below the prime modulus.
+uint64_t cipherCapacity(
+    uint64_t keySize    // size of the key in bits
+); // O(1)
+
+// Pack up to cipherCapacity(keySize) bytes of arbitrary data into a new intChain:
+//  The block holds its own length, so short and binary blocks round-trip exactly.
+struct intChain* cipherPackBlock(
+    const uint8_t* data,    // data to pack
+    uint64_t length,        // number of bytes of data, at least one
+    uint64_t keySize        // size of the key in bits
+); // O(keySize)
+
+// Unpack a block made by cipherPackBlock into a buffer of cipherCapacity(keySize) bytes:
+//  Returns the number of bytes unpacked, or UINT64_MAX if the block is malformed.
+uint64_t cipherUnpackBlock(
+    struct intChain* X,     // packed block
+    uint8_t* data,          // buffer to unpack into
+    uint64_t keySize        // size of the key in bits
+); // O(keySize)
+
+// Store a container header in a buffer of CIPHER_HEADER_SIZE bytes:
+void cipherPutHeader(
+    uint8_t* buffer,            // buffer to fill
+    struct cipherHeader* header // header to store
+);
+
+// Store one ciphertext block in a buffer of 16 * limbs bytes:
+//  Returns 0 on success, or 1 if a number is too large for the limb count.
+uint32_t cipherPutBlock(
+    uint8_t* buffer,                // buffer to fill
+    uint64_t limbs,                 // limbs per number
+    struct intChain* ScrambleCipher,
+    struct intChain* WordCipher
+);
+
+// Write a container header to a file:
+//  Returns 0 on success, or 1 if the write failed.
+uint32_t cipherWriteHeader(
+    FILE* fp,                   // file to write to
+    struct cipherHeader* header // header to write
+);
+
+// Write one ciphertext block to a file:
+//  Returns 0 on success, 1 if a number is too large for the header's limb count, or 2 if the write failed.
+uint32_t cipherWriteBlock(
+    FILE* fp,                       // file to write to
+    struct cipherHeader* header,    // header the file was started with
+    struct intChain* ScrambleCipher,
+    struct intChain* WordCipher
+);
+
+// Map a ciphertext file into memory and index its blocks:
+//  Files without the container magic are treated as legacy hex, with a zeroed header.
+//  Returns 0 on success, 1 if the file can't be opened or mapped, or 2 if the container is malformed.
+uint32_t cipherMapOpen(
+    struct cipherMap* map,  // view to fill in
+    const char* path        // path of the container
+);
+
+// Index a ciphertext that is already in memory, as cipherMapOpen does for files:
+//  The view borrows the buffer, which must outlive it.
+//  Returns 0 on success, or 2 if the container is malformed.
+uint32_t cipherMapBuffer(
+    struct cipherMap* map,  // view to fill in
+    const uint8_t* data,    // ciphertext
+    uint64_t length         // bytes of ciphertext
+);
+
+// Release a ciphertext view, unmapping the file if cipherMapOpen mapped it:
+void cipherMapClose(
+    struct cipherMap* map   // view to release
+);
+
+// Read block k of a mapped ciphertext straight out of the mapping:
+void cipherMapBlock(
+    struct cipherMap* map,              // view to read from
+    uint64_t k,                         // index of the block
+    struct intChain** ScrambleCipher,   // receives a new intChain
+    struct intChain** WordCipher        // receives a new intChain
+); // O(limbs)
@@ -1,93 +1,390 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "intChain.h"
+#include "cipherText.h"
+#include "chacha.h"
+#include "elgamal.h"
+#include "batchFiles.h"
 
+// The loaded key:
+//  Contexts are read-only, so every worker thread shares this one.
+static struct elgamalPrivate* privateKey;
 static uint64_t keySize;
-static struct intChain* PrimeModulus;
-static struct intChain* Generator;
-static struct intChain* Exponent;
 
-FILE* fp;
+// Size of the stdout buffer:
+#define OUTPUT_BUFFER (1 << 20)
+
+// Number of blocks in flight per worker thread:
+//  Workers steal within a window of blocks; the main thread writes the window out in order.
+#define WINDOW_PER_WORKER 256
+
+// Plaintext of one block, waiting to be written:
+struct plainBlock {
+	uint8_t* data;
+	uint64_t length;
+	uint32_t done;
+};
+
+// Range of block indices owned by one worker:
+//  The owner takes blocks from the front; thieves take half of what is left from the back.
+struct blockRange {
+	pthread_mutex_t lock;
+	uint64_t next;
+	uint64_t end;
+};
+
+static struct workPool {
+	pthread_mutex_t lock;
+	pthread_cond_t start;   // signalled when a new window is handed out
+	pthread_cond_t done;    // signalled when a worker finishes a block
+	struct blockRange* ranges;
+	struct plainBlock* blocks;
+	uint64_t windowSize;
+	uint64_t generation;    // bumped for every window
+	uint32_t finished;      // set once every window has been handed out
+} pool;
 
-static void decryptWord(
-    struct intChain* ScrambleCipher,
-    struct intChain* WordCipher
+static struct cipherMap map;
+static uint32_t workerCount = 1;
+static uint64_t plainCapacity;
+
+// Decrypt block k of the mapped ciphertext into a plainBlock:
+static void decryptBlock(
+    uint64_t k,
+    struct plainBlock* block
 ) {
-	struct intChain* PrimeModulusMinusTwo = intCopy(PrimeModulus);
-	intDecrement(PrimeModulusMinusTwo);
-	intDecrement(PrimeModulusMinusTwo);
-	struct intChain* Cipher = intModExp(ScrambleCipher, Exponent, PrimeModulus);
-	struct intChain* CipherInverse = intModExp(Cipher, PrimeModulusMinusTwo, PrimeModulus);
-	// struct intChain* temp = intMult(Cipher, CipherInverse);
-	// intMod(temp, PrimeModulus);
-	// printf("\n\n--> %s\n\n", intToString(temp));
-	struct intChain* EncodedPlaintext = intMult(WordCipher, CipherInverse);
-	intMod(EncodedPlaintext, PrimeModulus);
-	char* plaintext = intDecodeString(EncodedPlaintext);
-	printf("%s", plaintext);
-	intFree(PrimeModulusMinusTwo);
-	intFree(Cipher);
-	intFree(CipherInverse);
+	struct intChain* ScrambleCipher;
+	struct intChain* WordCipher;
+	cipherMapBlock(&map, k, &ScrambleCipher, &WordCipher);
+	struct intChain* EncodedPlaintext = elgamalDecryptWord(privateKey, ScrambleCipher, WordCipher);
+	if (map.header.flags & CIPHER_DENSE) {
+		block->length = cipherUnpackBlock(EncodedPlaintext, block->data, keySize);
+	} else {
+		// Blocks encoded with intEncodeString end at their first NUL:
+		char* plaintext = intDecodeString(EncodedPlaintext);
+		block->length = strlen(plaintext);
+		if (block->length > plainCapacity) {
+			block->length = UINT64_MAX;
+		} else {
+			memcpy(block->data, plaintext, block->length);
+		}
+		free(plaintext);
+	}
+	intFree(ScrambleCipher);
+	intFree(WordCipher);
 	intFree(EncodedPlaintext);
-	free(plaintext);
+}
+
+static void writeBlock(
+    struct plainBlock* block,
+    uint64_t k
+) {
+	if (block->length == UINT64_MAX) {
+		printf("Ciphertext block %" PRIu64 " is corrupt.\n", k);
+		exit(9);
+	}
+	fwrite(block->data, 1, block->length, stdout);
+}
+
+// Take the next block from a worker's own range, or steal half of another worker's range:
+//  Returns 0 once every range is empty.
+static uint32_t takeBlock(
+    uint32_t self,
+    uint64_t* k
+) {
+	struct blockRange* own = &pool.ranges[self];
+	pthread_mutex_lock(&own->lock);
+	if (own->next < own->end) {
+		*k = own->next++;
+		pthread_mutex_unlock(&own->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&own->lock);
+	uint32_t j;
+	for (j = 1; j < workerCount; j++) {
+		struct blockRange* victim = &pool.ranges[(self + j) % workerCount];
+		pthread_mutex_lock(&victim->lock);
+		uint64_t remaining = victim->end - victim->next;
+		if (remaining == 0) {
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		uint64_t stolenEnd = victim->end;
+		victim->end -= (remaining + 1) / 2;
+		uint64_t stolenStart = victim->end;
+		pthread_mutex_unlock(&victim->lock);
+		// Keep the first stolen block and make the rest this worker's new range:
+		pthread_mutex_lock(&own->lock);
+		own->next = stolenStart + 1;
+		own->end = stolenEnd;
+		pthread_mutex_unlock(&own->lock);
+		*k = stolenStart;
+		return 1;
+	}
+	return 0;
+}
+
+static void* workerThread(
+    void* argument
+) {
+	uint32_t self = (uint32_t)(uintptr_t) argument;
+	uint64_t seenGeneration = 0;
+	while (1) {
+		pthread_mutex_lock(&pool.lock);
+		while (pool.generation == seenGeneration && !pool.finished) {
+			pthread_cond_wait(&pool.start, &pool.lock);
+		}
+		if (pool.generation == seenGeneration) {
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+		seenGeneration = pool.generation;
+		pthread_mutex_unlock(&pool.lock);
+		uint64_t k;
+		while (takeBlock(self, &k)) {
+			// Block indices are absolute, so the slot is right whichever window the block came from.
+			struct plainBlock* block = &pool.blocks[k % pool.windowSize];
+			decryptBlock(k, block);
+			pthread_mutex_lock(&pool.lock);
+			block->done = 1;
+			pthread_cond_signal(&pool.done);
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+	intClearPool();
+	return 0;
+}
+
+// Decrypt every block of the mapped ciphertext across the worker threads, writing the plaintext in order:
+static void decryptParallel(
+    void
+) {
+	pool.windowSize = WINDOW_PER_WORKER * workerCount;
+	pool.blocks = calloc(pool.windowSize, sizeof * pool.blocks);
+	pool.ranges = calloc(workerCount, sizeof * pool.ranges);
+	pthread_mutex_init(&pool.lock, 0);
+	pthread_cond_init(&pool.start, 0);
+	pthread_cond_init(&pool.done, 0);
+	uint64_t k;
+	for (k = 0; k < pool.windowSize; k++) {
+		pool.blocks[k].data = malloc(plainCapacity);
+	}
+	pthread_t* workers = malloc(workerCount * sizeof * workers);
+	uint32_t j;
+	for (j = 0; j < workerCount; j++) {
+		pthread_mutex_init(&pool.ranges[j].lock, 0);
+		pthread_create(&workers[j], 0, workerThread, (void*)(uintptr_t) j);
+	}
+	uint64_t windowStart;
+	for (windowStart = 0; windowStart < map.blockCount; windowStart += pool.windowSize) {
+		uint64_t windowEnd = windowStart + pool.windowSize;
+		if (windowEnd > map.blockCount) {
+			windowEnd = map.blockCount;
+		}
+		// Every block of the previous window is written, so all ranges are empty; deal out the new one:
+		uint64_t share = (windowEnd - windowStart + workerCount - 1) / workerCount;
+		for (j = 0; j < workerCount; j++) {
+			struct blockRange* range = &pool.ranges[j];
+			pthread_mutex_lock(&range->lock);
+			range->next = windowStart + j * share;
+			range->end = range->next + share;
+			if (range->next > windowEnd) {
+				range->next = windowEnd;
+			}
+			if (range->end > windowEnd) {
+				range->end = windowEnd;
+			}
+			pthread_mutex_unlock(&range->lock);
+		}
+		pthread_mutex_lock(&pool.lock);
+		pool.generation++;
+		pthread_cond_broadcast(&pool.start);
+		for (k = windowStart; k < windowEnd; k++) {
+			struct plainBlock* block = &pool.blocks[k % pool.windowSize];
+			while (!block->done) {
+				pthread_cond_wait(&pool.done, &pool.lock);
+			}
+			block->done = 0;
+			pthread_mutex_unlock(&pool.lock);
+			writeBlock(block, k);
+			pthread_mutex_lock(&pool.lock);
+		}
+		pthread_mutex_unlock(&pool.lock);
+	}
+	pthread_mutex_lock(&pool.lock);
+	pool.finished = 1;
+	pthread_cond_broadcast(&pool.start);
+	pthread_mutex_unlock(&pool.lock);
+	for (j = 0; j < workerCount; j++) {
+		pthread_join(workers[j], 0);
+	}
+	for (k = 0; k < pool.windowSize; k++) {
+		free(pool.blocks[k].data);
+	}
+	free(pool.blocks);
+	free(pool.ranges);
+	free(workers);
+}
+
+// Recover the session key from the container's one ElGamal block, then stream-decrypt the payload straight out of the mapping:
+//  The payload is authenticated in full before any of it is decrypted.
+//  Returns 0 on success, 1 if the session block is corrupt, or 2 if the payload fails authentication.
+static uint32_t decryptHybrid(
+    void
+) {
+	uint8_t session[ELGAMAL_SESSION_SIZE];
+	struct intChain* ScrambleCipher;
+	struct intChain* WordCipher;
+	cipherMapBlock(&map, 0, &ScrambleCipher, &WordCipher);
+	uint32_t corrupt = elgamalDecapsulate(privateKey, ScrambleCipher, WordCipher, session);
+	intFree(ScrambleCipher);
+	intFree(WordCipher);
+	if (corrupt) {
+		return 1;
+	}
+	struct chachaSeal cipher;
+	chachaSealInit(&cipher, session, session + CHACHA_KEY_SIZE, map.data, map.payload - map.data);
+	memset(session, 0, sizeof session);
+	chachaSealAuthenticate(&cipher, map.payload, map.payloadLength);
+	if (chachaSealCheck(&cipher, map.tag) || map.payloadLength > cipher.cipher.remaining) {
+		memset(&cipher, 0, sizeof cipher);
+		return 2;
+	}
+	uint8_t* buffer = malloc(OUTPUT_BUFFER);
+	uint64_t position = 0;
+	while (position < map.payloadLength) {
+		uint64_t n = map.payloadLength - position;
+		if (n > OUTPUT_BUFFER) {
+			n = OUTPUT_BUFFER;
+		}
+		chachaXor(&cipher.cipher, buffer, map.payload + position, n);
+		fwrite(buffer, 1, n, stdout);
+		position += n;
+	}
+	memset(&cipher, 0, sizeof cipher);
+	free(buffer);
+	return 0;
+}
+
+// Decrypt one file's contents for batch mode:
+//  Only binary containers are accepted; legacy hex files need the streaming decryptor.
+static uint8_t* decryptFile(
+    const uint8_t* data,
+    uint64_t length,
+    uint64_t* resultLength,
+    const char* path
+) {
+	uint32_t status;
+	uint8_t* result = elgamalDecryptBuffer(privateKey, data, length, resultLength, &status);
+	if (status == 2) {
+		printf("%s is not a densely packed binary container.\n", path);
+	} else if (status == 3) {
+		printf("%s was not encrypted with this key.\n", path);
+	} else if (status) {
+		printf("%s has a corrupt block.\n", path);
+	}
+	return result;
 }
 
 int main(int argc, char* argv[]) {
-	if (argc < 3) {
-		printf("Usage: %s privateKeyFile cipherTextFile\n", argv[0]);
+	int option;
+	uint32_t batchMode = 0;
+	while ((option = getopt(argc, argv, "bj:")) != -1) {
+		if (option == 'b') {
+			batchMode = 1;
+		} else if (option == 'j') {
+			workerCount = strtoul(optarg, 0, 10);
+			if (workerCount == 0) {
+				workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+		} else {
+			argc = 0;
+		}
+	}
+	if (argc - optind < 2 + (int) batchMode) {
+		printf("Usage: %s [-j threads] privateKeyFile cipherTextFile\n", argv[0]);
+		printf("       %s -b [-j threads] privateKeyFile sourceDirectoryOrManifest destinationDirectory\n", argv[0]);
+		printf("\t-b\tdecrypt every file of a directory, or listed in a manifest, into the destination directory\n");
+		printf("\t-j\tdecrypt on this many threads, or 0 for one per core (default 1)\n");
 		return 1;
 	}
-	fp = fopen(argv[1], "r");
-	if (fp == 0) {
+	argv += optind - 1;
+	setvbuf(stdout, 0, _IOFBF, OUTPUT_BUFFER);
+	uint32_t status;
+	privateKey = elgamalPrivateLoad(argv[1], &status);
+	if (status == 1) {
 		printf("Couldn't open privateKeyFile.");
 		return 2;
-	}
-	keySize = 0;
-	if (fscanf(fp, "%*13[^/]%lu", &keySize) != 1) {
-		printf("The private key file is improperly formatted. %lu\n", keySize);
+	} else if (status) {
+		printf("The private key file is improperly formatted.\n");
 		return 3;
 	}
-	fflush(stdout);
-	char* string = malloc((keySize / 64 + 1) * 17 + 2);
-	if (fscanf(fp, "%*22[^/]%[^\n]", string) != 1) {
-		printf("The private key file is improperly formatted.\n");
-		return 4;
+	keySize = elgamalPrivateKeySize(privateKey);
+	if (batchMode) {
+		char** inputs;
+		char** outputs;
+		uint64_t count;
+		if (batchList(argv[2], argv[3], &inputs, &outputs, &count)) {
+			printf("Couldn't read the batch source.\n");
+			return 2;
+		}
+		uint64_t failures = batchRun(inputs, outputs, count, workerCount, decryptFile);
+		batchFreeList(inputs, outputs, count);
+		elgamalPrivateFree(privateKey);
+		if (failures) {
+			printf("%" PRIu64 " of %" PRIu64 " files failed.\n", failures, count);
+			return 9;
+		}
+		return 0;
 	}
-	PrimeModulus = intFromString(string);
-	if (fscanf(fp, "%*13[^/]%[^\n]", string) != 1) {
-		printf("The private key file is improperly formatted.\n");
-		return 5;
+	if (cipherMapOpen(&map, argv[2])) {
+		printf("The ciphertext file is unreadable or improperly formatted.\n");
+		return 7;
 	}
-	Generator = intFromString(string);
-	if (fscanf(fp, "%*12[^/]%[^\n]", string) != 1) {
-		printf("The private key file is improperly formatted.\n");
-		return 6;
-	}
-	Exponent = intFromString(string);
-	fclose(fp);
-	fp = fopen(argv[2], "r");
-	uint32_t stillReading = 1;
-	while (stillReading) {
-		if (fscanf(fp, "%[^\n]%*1[^/]", string) == EOF) {
-			break;
+	if (!map.hex) {
+		// Binary container; check it was made for this key before decrypting:
+		if (map.header.keyId != elgamalPrivateKeyId(privateKey) || map.header.keySize != keySize) {
+			printf("The ciphertext was not encrypted with this key.\n");
+			return 8;
 		}
-		struct intChain* ScrambleCipher = intFromString(string);
-		if (fscanf(fp, "%[^\n]%*2[^/]", string) == EOF) {
-			break;
+	}
+	// Room for a dense block, or for a legacy block decoded from a number below the modulus:
+	plainCapacity = cipherCapacity(keySize);
+	if (plainCapacity < 8 * cipherLimbs(keySize)) {
+		plainCapacity = 8 * cipherLimbs(keySize);
+	}
+	if (map.header.flags & CIPHER_HYBRID) {
+		uint32_t corrupt = decryptHybrid();
+		if (corrupt == 1) {
+			printf("The session key block is corrupt.\n");
+			return 9;
+		} else if (corrupt) {
+			printf("The payload failed authentication.\n");
+			return 9;
+		}
+	} else if (workerCount > 1) {
+		decryptParallel();
+	} else {
+		struct plainBlock block = {malloc(plainCapacity), 0, 0};
+		uint64_t k;
+		for (k = 0; k < map.blockCount; k++) {
+			decryptBlock(k, &block);
+			writeBlock(&block, k);
 		}
-		struct intChain* WordCipher = intFromString(string);
-		decryptWord(ScrambleCipher, WordCipher);
-		intFree(ScrambleCipher);
-		intFree(WordCipher);
-	}
-	printf("\n");
-	fclose(fp);
-	free(string);
-	intFree(PrimeModulus);
-	intFree(Generator);
-	intFree(Exponent);
+		free(block.data);
+	}
+	if (!(map.header.flags & CIPHER_DENSE)) {
+		// The legacy packing has always ended with a newline.
+		printf("\n");
+	}
+	cipherMapClose(&map);
+	elgamalPrivateFree(privateKey);
 	return 0;
 }
@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "elgamal.h"
+#include "keyFile.h"
+#include "cipherText.h"
+#include "chacha.h"
+#include "trace.h"
+
+// elgamal.c
+// In-process ElGamal library: key contexts built once, then block-level and buffer-to-buffer calls.
+
+// Key contexts are loaded keys:
+//  Both keep the Montgomery constants of their modulus, so no block rebuilds them, and private contexts also keep the
+//  schedule of their decryption exponent, so decrypting a block doesn't rescan it.
+struct elgamalPublic {
+	struct keyFile key;
+	struct intModulus* Modulus;
+};
+struct elgamalPrivate {
+	struct keyFile key;
+	struct intModulus* Modulus;
+	struct intExponentPlan* Decryption;
+};
+
+// Record the reason for a failure, if the caller asked for it:
+static void setStatus(
+    uint32_t* status,
+    uint32_t value
+) {
+	if (status) {
+		*status = value;
+	}
+}
+
+// Load a public key context from a text key or key bundle:
+struct elgamalPublic* elgamalPublicLoad(
+    const char* path,
+    uint32_t* status
+) {
+	struct elgamalPublic* context = malloc(sizeof * context);
+	assert(context);
+	uint32_t result = keyLoad(&context->key, path);
+	if (result == 0) {
+		// intModulusMake refuses even moduli, which leave the key unusable:
+		context->Modulus = intModulusMake(context->key.PrimeModulus);
+		if (!context->Modulus) {
+			keyRelease(&context->key);
+			result = 2;
+		}
+	}
+	setStatus(status, result);
+	if (result) {
+		free(context);
+		return 0;
+	}
+	return context;
+}
+
+// Load a private key context from a text key or key bundle:
+struct elgamalPrivate* elgamalPrivateLoad(
+    const char* path,
+    uint32_t* status
+) {
+	struct elgamalPrivate* context = malloc(sizeof * context);
+	assert(context);
+	uint32_t result = keyLoad(&context->key, path);
+	if (result == 0 && context->key.kind != KEY_PRIVATE) {
+		keyRelease(&context->key);
+		result = 2;
+	}
+	if (result == 0) {
+		// intModulusMake refuses even moduli, which leave the key unusable:
+		context->Modulus = intModulusMake(context->key.PrimeModulus);
+		if (!context->Modulus) {
+			keyRelease(&context->key);
+			result = 2;
+		}
+	}
+	setStatus(status, result);
+	if (result) {
+		free(context);
+		return 0;
+	}
+	context->Decryption = intExponentPlanMake(context->key.DecryptionExponent);
+	return context;
+}
+
+// Free key contexts:
+void elgamalPublicFree(
+    struct elgamalPublic* key
+) {
+	intModulusFree(key->Modulus);
+	keyRelease(&key->key);
+	free(key);
+}
+
+void elgamalPrivateFree(
+    struct elgamalPrivate* key
+) {
+	intModulusFree(key->Modulus);
+	intExponentPlanFree(key->Decryption);
+	keyRelease(&key->key);
+	free(key);
+}
+
+// Approximate memory held by a loaded key: its numbers, as heads and nodes, and its bundle mapping:
+static uint64_t keyFootprint(
+    struct keyFile* key
+) {
+	struct intChain* numbers[] = {
+		key->PrimeModulus, key->Generator, key->Exponential, key->Exponent, key->DecryptionExponent
+	};
+	uint64_t bytes = sizeof * key + key->length;
+	uint32_t j;
+	for (j = 0; j < sizeof numbers / sizeof * numbers; j++) {
+		if (numbers[j]) {
+			bytes += sizeof(struct intChainStorage) + key->limbs * 2 * sizeof(uint64_t);
+		}
+	}
+	return bytes;
+}
+
+uint64_t elgamalPublicFootprint(
+    struct elgamalPublic* key
+) {
+	return sizeof * key + keyFootprint(&key->key) - sizeof key->key + intModulusBytes(key->Modulus);
+}
+
+uint64_t elgamalPrivateFootprint(
+    struct elgamalPrivate* key
+) {
+	return sizeof * key + keyFootprint(&key->key) - sizeof key->key
+	       + intModulusBytes(key->Modulus) + intExponentPlanBytes(key->Decryption);
+}
+
+uint64_t elgamalPublicKeySize(
+    struct elgamalPublic* key
+) {
+	return key->key.keySize;
+}
+
+uint64_t elgamalPublicKeyId(
+    struct elgamalPublic* key
+) {
+	return key->key.keyId;
+}
+
+uint64_t elgamalPublicCapacity(
+    struct elgamalPublic* key
+) {
+	return cipherCapacity(key->key.keySize);
+}
+
+uint64_t elgamalPrivateKeySize(
+    struct elgamalPrivate* key
+) {
+	return key->key.keySize;
+}
+
+uint64_t elgamalPrivateKeyId(
+    struct elgamalPrivate* key
+) {
+	return key->key.keyId;
+}
+
+// Encrypt an encoded plaintext below the modulus into a new pair of ciphertext numbers:
+void elgamalEncryptWord(
+    struct elgamalPublic* key,
+    const struct intChain* IntWord,
+    struct intChain** ScrambleCipher,
+    struct intChain** WordCipher
+) {
+	uint64_t start = traceBegin();
+	struct keyFile* k = &key->key;
+	// The intChain primitives never modify their inputs, so every thread can use the key's modulus and constants directly:
+	const struct intChain* PrimeModulus = k->PrimeModulus;
+	struct intChain* Scramble = intCryptoRandom(PrimeModulus);
+	struct intChain* ScrambledExponential;
+	const struct intModulus* Modulus = key->Modulus;
+	if (k->generatorTable) {
+		// Key bundles carry the powers of two of both bases, so no squarings are needed:
+		*ScrambleCipher = intModulusExpTable(k->generatorTable, k->limbs, k->tableEntries, Scramble, Modulus);
+		ScrambledExponential = intModulusExpTable(k->exponentialTable, k->limbs, k->tableEntries, Scramble, Modulus);
+	} else {
+		*ScrambleCipher = intModulusExp(k->Generator, Scramble, Modulus);
+		ScrambledExponential = intModulusExp(k->Exponential, Scramble, Modulus);
+	}
+	*WordCipher = intModulusMult(IntWord, ScrambledExponential, Modulus);
+	intFree(Scramble);
+	intFree(ScrambledExponential);
+	traceEnd("encryptBlock", start, 0);
+}
+
+// Decrypt a pair of ciphertext numbers, returning a new intChain holding the encoded plaintext:
+struct intChain* elgamalDecryptWord(
+    struct elgamalPrivate* key,
+    const struct intChain* ScrambleCipher,
+    const struct intChain* WordCipher
+) {
+	uint64_t start = traceBegin();
+	// ScrambleCipher^DecryptionExponent is the inverse of the shared secret ScrambleCipher^Exponent:
+	struct intChain* CipherInverse = intModulusExpPlan(ScrambleCipher, key->Decryption, key->Modulus);
+	struct intChain* EncodedPlaintext = intModulusMult(WordCipher, CipherInverse, key->Modulus);
+	intFree(CipherInverse);
+	traceEnd("decryptBlock", start, 0);
+	return EncodedPlaintext;
+}
+
+// Encrypt up to elgamalPublicCapacity(key) bytes into one ciphertext record:
+void elgamalEncryptBlock(
+    struct elgamalPublic* key,
+    const uint8_t* data,
+    uint64_t length,
+    uint8_t* record
+) {
+	struct intChain* IntWord = cipherPackBlock(data, length, key->key.keySize);
+	struct intChain* ScrambleCipher;
+	struct intChain* WordCipher;
+	elgamalEncryptWord(key, IntWord, &ScrambleCipher, &WordCipher);
+	// Both numbers are below the modulus, so they always fit:
+	cipherPutBlock(record, key->key.limbs, ScrambleCipher, WordCipher);
+	intFree(IntWord);
+	intFree(ScrambleCipher);
+	intFree(WordCipher);
+}
+
+// Decrypt one ciphertext record:
+uint64_t elgamalDecryptBlock(
+    struct elgamalPrivate* key,
+    const uint8_t* record,
+    uint8_t* data
+) {
+	uint64_t limbs = key->key.limbs;
+	struct intChain* ScrambleCipher = intFromLimbs(record, limbs);
+	struct intChain* WordCipher = intFromLimbs(record + 8 * limbs, limbs);
+	struct intChain* EncodedPlaintext = elgamalDecryptWord(key, ScrambleCipher, WordCipher);
+	uint64_t length = cipherUnpackBlock(EncodedPlaintext, data, key->key.keySize);
+	intFree(ScrambleCipher);
+	intFree(WordCipher);
+	intFree(EncodedPlaintext);
+	return length;
+}
+
+// Encrypt a fresh random session key and nonce into a pair of ciphertext numbers:
+uint32_t elgamalEncapsulate(
+    struct elgamalPublic* key,
+    uint8_t* session,
+    struct intChain** ScrambleCipher,
+    struct intChain** WordCipher
+) {
+	assert(cipherCapacity(key->key.keySize) >= ELGAMAL_SESSION_SIZE);
+	if (syscall(SYS_getrandom, session, ELGAMAL_SESSION_SIZE, 0) != ELGAMAL_SESSION_SIZE) {
+		return 1;
+	}
+	struct intChain* IntWord = cipherPackBlock(session, ELGAMAL_SESSION_SIZE, key->key.keySize);
+	elgamalEncryptWord(key, IntWord, ScrambleCipher, WordCipher);
+	intFree(IntWord);
+	return 0;
+}
+
+// Recover a session key and nonce made by elgamalEncapsulate:
+uint32_t elgamalDecapsulate(
+    struct elgamalPrivate* key,
+    const struct intChain* ScrambleCipher,
+    const struct intChain* WordCipher,
+    uint8_t* session
+) {
+	uint8_t* data = malloc(cipherCapacity(key->key.keySize));
+	assert(data);
+	struct intChain* EncodedPlaintext = elgamalDecryptWord(key, ScrambleCipher, WordCipher);
+	uint64_t length = cipherUnpackBlock(EncodedPlaintext, data, key->key.keySize);
+	intFree(EncodedPlaintext);
+	uint32_t status = 1;
+	if (length == ELGAMAL_SESSION_SIZE) {
+		memcpy(session, data, ELGAMAL_SESSION_SIZE);
+		status = 0;
+	}
+	memset(data, 0, cipherCapacity(key->key.keySize));
+	free(data);
+	return status;
+}
+
+// Encrypt a buffer into a newly allocated binary ciphertext container:
+uint8_t* elgamalEncryptBuffer(
+    struct elgamalPublic* key,
+    const uint8_t* data,
+    uint64_t length,
+    uint32_t flags,
+    uint64_t* cipherLength
+) {
+	struct cipherHeader header = {0};
+	header.version = CIPHER_VERSION;
+	header.flags = CIPHER_DENSE | (flags & ELGAMAL_HYBRID ? CIPHER_HYBRID : 0);
+	header.keySize = key->key.keySize;
+	header.limbs = key->key.limbs;
+	header.keyId = key->key.keyId;
+	uint64_t recordSize = 16 * header.limbs;
+	uint64_t capacity = cipherCapacity(header.keySize);
+	if (flags & ELGAMAL_HYBRID) {
+		*cipherLength = CIPHER_HEADER_SIZE + recordSize + length + CIPHER_TAG_SIZE;
+	} else {
+		*cipherLength = CIPHER_HEADER_SIZE + (length + capacity - 1) / capacity * recordSize;
+	}
+	uint8_t* cipher = malloc(*cipherLength);
+	assert(cipher);
+	cipherPutHeader(cipher, &header);
+	uint8_t* record = cipher + CIPHER_HEADER_SIZE;
+	if (flags & ELGAMAL_HYBRID) {
+		uint8_t session[ELGAMAL_SESSION_SIZE];
+		struct intChain* ScrambleCipher;
+		struct intChain* WordCipher;
+		if (elgamalEncapsulate(key, session, &ScrambleCipher, &WordCipher)) {
+			free(cipher);
+			return 0;
+		}
+		cipherPutBlock(record, header.limbs, ScrambleCipher, WordCipher);
+		intFree(ScrambleCipher);
+		intFree(WordCipher);
+		// The header and the session block are authenticated along with the payload:
+		struct chachaSeal stream;
+		chachaSealInit(&stream, session, session + CHACHA_KEY_SIZE, cipher, CIPHER_HEADER_SIZE + recordSize);
+		uint32_t tooLong = chachaSealEncrypt(&stream, record + recordSize, data, length);
+		chachaSealFinish(&stream, record + recordSize + length);
+		memset(session, 0, sizeof session);
+		memset(&stream, 0, sizeof stream);
+		if (tooLong) {
+			free(cipher);
+			return 0;
+		}
+		return cipher;
+	}
+	while (length) {
+		uint64_t n = length < capacity ? length : capacity;
+		elgamalEncryptBlock(key, data, n, record);
+		data += n;
+		length -= n;
+		record += recordSize;
+	}
+	return cipher;
+}
+
+// Decrypt a binary ciphertext container into a newly allocated buffer:
+uint8_t* elgamalDecryptBuffer(
+    struct elgamalPrivate* key,
+    const uint8_t* cipher,
+    uint64_t cipherLength,
+    uint64_t* length,
+    uint32_t* status
+) {
+	struct cipherMap map;
+	if (cipherMapBuffer(&map, cipher, cipherLength) || map.hex || !(map.header.flags & CIPHER_DENSE)) {
+		cipherMapClose(&map);
+		setStatus(status, 2);
+		return 0;
+	}
+	if (map.header.keyId != key->key.keyId || map.header.keySize != key->key.keySize) {
+		cipherMapClose(&map);
+		setStatus(status, 3);
+		return 0;
+	}
+	uint8_t* data;
+	*length = 0;
+	if (map.header.flags & CIPHER_HYBRID) {
+		uint8_t session[ELGAMAL_SESSION_SIZE];
+		struct intChain* ScrambleCipher;
+		struct intChain* WordCipher;
+		cipherMapBlock(&map, 0, &ScrambleCipher, &WordCipher);
+		uint32_t corrupt = elgamalDecapsulate(key, ScrambleCipher, WordCipher, session);
+		intFree(ScrambleCipher);
+		intFree(WordCipher);
+		if (corrupt) {
+			cipherMapClose(&map);
+			setStatus(status, 4);
+			return 0;
+		}
+		// Check the tag before decrypting anything:
+		struct chachaSeal stream;
+		chachaSealInit(&stream, session, session + CHACHA_KEY_SIZE, map.data, map.payload - map.data);
+		chachaSealAuthenticate(&stream, map.payload, map.payloadLength);
+		memset(session, 0, sizeof session);
+		if (chachaSealCheck(&stream, map.tag) || map.payloadLength > stream.cipher.remaining) {
+			memset(&stream, 0, sizeof stream);
+			cipherMapClose(&map);
+			setStatus(status, 4);
+			return 0;
+		}
+		// malloc(0) may return 0, so always ask for at least a byte:
+		data = malloc(map.payloadLength + 1);
+		assert(data);
+		chachaXor(&stream.cipher, data, map.payload, map.payloadLength);
+		*length = map.payloadLength;
+		memset(&stream, 0, sizeof stream);
+	} else {
+		data = malloc(map.blockCount * cipherCapacity(map.header.keySize) + 1);
+		assert(data);
+		uint64_t k;
+		for (k = 0; k < map.blockCount; k++) {
+			uint64_t n = elgamalDecryptBlock(key, map.blocks + 16 * map.header.limbs * k, data + *length);
+			if (n == UINT64_MAX) {
+				free(data);
+				cipherMapClose(&map);
+				setStatus(status, 4);
+				return 0;
+			}
+			*length += n;
+		}
+	}
+	cipherMapClose(&map);
+	setStatus(status, 0);
+	return data;
+}
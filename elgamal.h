@@ -0,0 +1,141 @@
+#pragma once
+#include <stdint.h>
+
+#include "intChain.h"
+
+// elgamal.h
+// In-process ElGamal library: key contexts built once, then block-level and buffer-to-buffer calls.
+//  Key contexts are read-only after loading, so one context can serve many threads at once.
+
+// Opaque key contexts:
+struct elgamalPublic;
+struct elgamalPrivate;
+
+// Flags for elgamalEncryptBuffer:
+//  ELGAMAL_HYBRID: encapsulate a ChaCha20 session key and stream-encrypt the data under it, with a Poly1305 tag.
+#define ELGAMAL_HYBRID 0x0001
+
+// Bytes of session key and nonce carried by elgamalEncapsulate:
+#define ELGAMAL_SESSION_SIZE 44
+
+// Load a public key context from a text key or key bundle:
+//  Private key files are accepted too. Returns 0 on failure, with status 1 if the file
+//  can't be read or 2 if it is improperly formatted.
+struct elgamalPublic* elgamalPublicLoad(
+    const char* path,   // path of the key file
+    uint32_t* status    // receives the failure reason; may be 0
+);
+
+// Load a private key context from a text key or key bundle:
+//  Returns 0 on failure, with status 1 if the file can't be read or 2 if it isn't a private key.
+struct elgamalPrivate* elgamalPrivateLoad(
+    const char* path,   // path of the key file
+    uint32_t* status    // receives the failure reason; may be 0
+);
+
+// Free key contexts:
+void elgamalPublicFree(
+    struct elgamalPublic* key
+);
+void elgamalPrivateFree(
+    struct elgamalPrivate* key
+);
+
+// Properties of key contexts:
+//  The size of the key in bits, the id recorded in ciphertext headers,
+//  and the number of plaintext bytes elgamalEncryptBlock packs into one block.
+uint64_t elgamalPublicKeySize(
+    struct elgamalPublic* key
+);
+uint64_t elgamalPublicKeyId(
+    struct elgamalPublic* key
+);
+uint64_t elgamalPublicCapacity(
+    struct elgamalPublic* key
+);
+uint64_t elgamalPrivateKeySize(
+    struct elgamalPrivate* key
+);
+uint64_t elgamalPrivateKeyId(
+    struct elgamalPrivate* key
+);
+
+// Approximate memory held by key contexts, including precomputed constants, plans and mapped bundles:
+//  For caches that keep contexts within a memory budget.
+uint64_t elgamalPublicFootprint(
+    struct elgamalPublic* key
+);
+uint64_t elgamalPrivateFootprint(
+    struct elgamalPrivate* key
+);
+
+// Encrypt an encoded plaintext below the modulus into a new pair of ciphertext numbers:
+void elgamalEncryptWord(
+    struct elgamalPublic* key,
+    const struct intChain* IntWord,     // encoded plaintext
+    struct intChain** ScrambleCipher,   // receives a new intChain
+    struct intChain** WordCipher        // receives a new intChain
+);
+
+// Decrypt a pair of ciphertext numbers, returning a new intChain holding the encoded plaintext:
+struct intChain* elgamalDecryptWord(
+    struct elgamalPrivate* key,
+    const struct intChain* ScrambleCipher,
+    const struct intChain* WordCipher
+);
+
+// Encrypt up to elgamalPublicCapacity(key) bytes into one ciphertext record of 16 * limbs bytes:
+//  This is the record layout of the binary ciphertext container, with dense packing.
+void elgamalEncryptBlock(
+    struct elgamalPublic* key,
+    const uint8_t* data,    // plaintext
+    uint64_t length,        // bytes of plaintext, at least one
+    uint8_t* record         // buffer to receive the record
+);
+
+// Decrypt one ciphertext record into a buffer of elgamalPublicCapacity bytes:
+//  Returns the number of bytes of plaintext, or UINT64_MAX if the record is corrupt.
+uint64_t elgamalDecryptBlock(
+    struct elgamalPrivate* key,
+    const uint8_t* record,  // record to decrypt
+    uint8_t* data           // buffer to receive the plaintext
+);
+
+// Encrypt a fresh random session key and nonce into a pair of ciphertext numbers:
+//  Returns 0 on success, or 1 if no randomness was available.
+uint32_t elgamalEncapsulate(
+    struct elgamalPublic* key,
+    uint8_t* session,                   // receives ELGAMAL_SESSION_SIZE bytes: the key, then the nonce
+    struct intChain** ScrambleCipher,   // receives a new intChain
+    struct intChain** WordCipher        // receives a new intChain
+);
+
+// Recover a session key and nonce made by elgamalEncapsulate:
+//  Returns 0 on success, or 1 if the ciphertext doesn't hold a session.
+uint32_t elgamalDecapsulate(
+    struct elgamalPrivate* key,
+    const struct intChain* ScrambleCipher,
+    const struct intChain* WordCipher,
+    uint8_t* session                    // receives ELGAMAL_SESSION_SIZE bytes
+);
+
+// Encrypt a buffer into a newly allocated binary ciphertext container:
+//  Returns 0 if no randomness was available, or if the data is too long for one hybrid keystream (256 GiB).
+uint8_t* elgamalEncryptBuffer(
+    struct elgamalPublic* key,
+    const uint8_t* data,        // plaintext
+    uint64_t length,            // bytes of plaintext
+    uint32_t flags,             // ELGAMAL_HYBRID or 0
+    uint64_t* cipherLength      // receives the size of the container
+);
+
+// Decrypt a binary ciphertext container into a newly allocated buffer:
+//  Returns 0 on failure, with status 2 if the container is malformed or not densely packed,
+//  3 if it was made for another key, or 4 if a block is corrupt or a hybrid payload fails authentication.
+uint8_t* elgamalDecryptBuffer(
+    struct elgamalPrivate* key,
+    const uint8_t* cipher,      // ciphertext container
+    uint64_t cipherLength,      // size of the container
+    uint64_t* length,           // receives the bytes of plaintext
+    uint32_t* status            // receives the failure reason; may be 0
+);
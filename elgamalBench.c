@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "intChain.h"
+#include "elgamal.h"
+
+// End-to-end benchmark:
+//  For each key size, generate a key pair with keyGenerator, push a synthetic corpus through encryptor and decryptor
+//  as an operator would, then time every block of the same corpus through libelgamal for the latency distribution.
+//  Every round trip is checked byte for byte.
+
+extern char** environ;
+
+// Longest path built inside the scratch directory:
+#define PATH_SIZE 256
+
+// Results for one key size:
+struct endToEndResult {
+	uint64_t keySize;
+	double keygenSeconds;
+	double encryptSeconds;
+	double decryptSeconds;
+	uint64_t cipherBytes;
+	uint64_t blocks;
+	double encryptPercentiles[4];   // p50, p99, p99.9 and max, in microseconds
+	double decryptPercentiles[4];
+	uint32_t verified;
+};
+
+static const char* toolDirectory = ".";
+static char scratch[] = "/tmp/elgamalBench.XXXXXX";
+static uint64_t corpusSize = 65536;
+static const char* threads = "1";
+static uint32_t hybridMode;
+static uint32_t useBundles;
+
+static uint64_t monotonicNanoseconds(
+    void
+) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Fill a buffer with a repeatable corpus: the first half word-like text, the second half random bytes:
+static void makeCorpus(
+    uint8_t* corpus,
+    uint64_t length,
+    uint64_t seed
+) {
+	static const char* words[] = {
+		"the ", "modulus ", "prime ", "of ", "a ", "generator ", "cipher ", "and ", "key ", "block ",
+		"secret ", "to ", "random ", "is ", "exponent ", "in ", ".\n", ", ", "group ", "message "
+	};
+	uint64_t state = seed | 1;
+	uint64_t k = 0;
+	while (k < length / 2) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		const char* word = words[state % (sizeof words / sizeof * words)];
+		while (*word && k < length / 2) {
+			corpus[k++] = *word++;
+		}
+	}
+	while (k < length) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		corpus[k++] = state >> 56;
+	}
+}
+
+// Run one of the tools with stdin and stdout redirected, returning the seconds it took, or -1 if it failed:
+static double runTool(
+    char* const* arguments,
+    const char* input,
+    const char* output
+) {
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 0, input ? input : "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, 1, output ? output : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	uint64_t start = monotonicNanoseconds();
+	pid_t child;
+	int status = -1;
+	if (posix_spawn(&child, arguments[0], &actions, 0, arguments, environ) == 0) {
+		waitpid(child, &status, 0);
+	}
+	double seconds = (monotonicNanoseconds() - start) / 1e9;
+	posix_spawn_file_actions_destroy(&actions);
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("%s failed.\n", arguments[0]);
+		return -1;
+	}
+	return seconds;
+}
+
+static void scratchPath(
+    char* path,
+    const char* name
+) {
+	snprintf(path, PATH_SIZE, "%s/%s", scratch, name);
+}
+
+static void toolPath(
+    char* path,
+    const char* name
+) {
+	snprintf(path, PATH_SIZE, "%s/%s", toolDirectory, name);
+}
+
+static uint32_t sameContents(
+    const char* path,
+    const uint8_t* data,
+    uint64_t length
+) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return 0;
+	}
+	uint8_t* contents = malloc(length + 1);
+	uint64_t got = fread(contents, 1, length + 1, file);
+	fclose(file);
+	uint32_t same = got == length && memcmp(contents, data, length) == 0;
+	free(contents);
+	return same;
+}
+
+static int compareDoubles(
+    const void* a,
+    const void* b
+) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static void percentiles(
+    double* samples,
+    uint64_t count,
+    double* out
+) {
+	qsort(samples, count, sizeof * samples, compareDoubles);
+	out[0] = samples[count / 2];
+	out[1] = samples[count * 99 / 100];
+	out[2] = samples[count * 999 / 1000];
+	out[3] = samples[count - 1];
+}
+
+// Time every block of the corpus through the library, and check it decrypts back:
+static uint32_t measureBlocks(
+    const char* publicPath,
+    const char* privatePath,
+    const uint8_t* corpus,
+    struct endToEndResult* result
+) {
+	uint32_t status;
+	struct elgamalPublic* publicKey = elgamalPublicLoad(publicPath, &status);
+	struct elgamalPrivate* privateKey = elgamalPrivateLoad(privatePath, &status);
+	if (!publicKey || !privateKey) {
+		printf("Couldn't load the generated keys.\n");
+		return 1;
+	}
+	uint64_t capacity = elgamalPublicCapacity(publicKey);
+	uint64_t recordSize = 16 * ((elgamalPublicKeySize(publicKey) + 63) / 64);
+	result->blocks = (corpusSize + capacity - 1) / capacity;
+	double* encryptSamples = malloc(result->blocks * sizeof * encryptSamples);
+	double* decryptSamples = malloc(result->blocks * sizeof * decryptSamples);
+	uint8_t* record = malloc(recordSize);
+	uint8_t* plain = malloc(capacity);
+	uint64_t k;
+	uint32_t verified = 1;
+	for (k = 0; k < result->blocks; k++) {
+		uint64_t offset = k * capacity;
+		uint64_t length = corpusSize - offset < capacity ? corpusSize - offset : capacity;
+		uint64_t start = monotonicNanoseconds();
+		elgamalEncryptBlock(publicKey, corpus + offset, length, record);
+		uint64_t middle = monotonicNanoseconds();
+		uint64_t got = elgamalDecryptBlock(privateKey, record, plain);
+		uint64_t end = monotonicNanoseconds();
+		encryptSamples[k] = (middle - start) / 1e3;
+		decryptSamples[k] = (end - middle) / 1e3;
+		verified &= got == length && memcmp(plain, corpus + offset, length) == 0;
+	}
+	percentiles(encryptSamples, result->blocks, result->encryptPercentiles);
+	percentiles(decryptSamples, result->blocks, result->decryptPercentiles);
+	result->verified &= verified;
+	free(encryptSamples);
+	free(decryptSamples);
+	free(record);
+	free(plain);
+	elgamalPublicFree(publicKey);
+	elgamalPrivateFree(privateKey);
+	return 0;
+}
+
+// Run the whole keygen -> encrypt -> decrypt round trip at one key size:
+static uint32_t measureKeySize(
+    uint64_t keySize,
+    const uint8_t* corpus,
+    struct endToEndResult* result
+) {
+	char keyGenerator[PATH_SIZE], keyBundler[PATH_SIZE], encryptor[PATH_SIZE], decryptor[PATH_SIZE];
+	char privatePath[PATH_SIZE], publicPath[PATH_SIZE], corpusPath[PATH_SIZE], cipherPath[PATH_SIZE], outputPath[PATH_SIZE];
+	char size[32];
+	toolPath(keyGenerator, "keyGenerator");
+	toolPath(keyBundler, "keyBundler");
+	toolPath(encryptor, "encryptor");
+	toolPath(decryptor, "decryptor");
+	scratchPath(privatePath, "private");
+	scratchPath(publicPath, "public");
+	scratchPath(corpusPath, "corpus");
+	scratchPath(cipherPath, "cipher");
+	scratchPath(outputPath, "output");
+	snprintf(size, sizeof size, "%" PRIu64, keySize);
+	memset(result, 0, sizeof * result);
+	result->keySize = keySize;
+	result->verified = 1;
+	char* generate[] = {keyGenerator, size, privatePath, publicPath, 0};
+	result->keygenSeconds = runTool(generate, 0, 0);
+	if (result->keygenSeconds < 0) {
+		return 1;
+	}
+	if (useBundles) {
+		char privateBundle[PATH_SIZE], publicBundle[PATH_SIZE];
+		scratchPath(privateBundle, "private.b");
+		scratchPath(publicBundle, "public.b");
+		char* bundlePrivate[] = {keyBundler, privatePath, privateBundle, 0};
+		char* bundlePublic[] = {keyBundler, publicPath, publicBundle, 0};
+		if (runTool(bundlePrivate, 0, 0) < 0 || runTool(bundlePublic, 0, 0) < 0) {
+			return 1;
+		}
+		strcpy(privatePath, privateBundle);
+		strcpy(publicPath, publicBundle);
+	}
+	char* encrypt[] = {encryptor, "-j", (char*) threads, publicPath, cipherPath, 0, 0};
+	if (hybridMode) {
+		encrypt[3] = "-k";
+		encrypt[4] = publicPath;
+		encrypt[5] = cipherPath;
+	}
+	char* decrypt[] = {decryptor, "-j", (char*) threads, privatePath, cipherPath, 0};
+	result->encryptSeconds = runTool(encrypt, corpusPath, 0);
+	result->decryptSeconds = runTool(decrypt, 0, outputPath);
+	if (result->encryptSeconds < 0 || result->decryptSeconds < 0) {
+		return 1;
+	}
+	FILE* cipher = fopen(cipherPath, "rb");
+	if (cipher) {
+		fseek(cipher, 0, SEEK_END);
+		result->cipherBytes = ftell(cipher);
+		fclose(cipher);
+	}
+	result->verified = sameContents(outputPath, corpus, corpusSize);
+	return measureBlocks(publicPath, privatePath, corpus, result);
+}
+
+static void writeJson(
+    FILE* out,
+    struct endToEndResult* results,
+    uint64_t count
+) {
+	fprintf(
+	    out, "{\n\"corpusBytes\": %" PRIu64 ",\n\"threads\": %s,\n\"hybrid\": %u,\n\"bundles\": %u,\n\"results\": [\n",
+	    corpusSize, threads, hybridMode, useBundles
+	);
+	uint64_t k;
+	for (k = 0; k < count; k++) {
+		struct endToEndResult* result = &results[k];
+		fprintf(
+		    out,
+		    "{\"keySize\": %" PRIu64 ", \"verified\": %u, \"keygenSeconds\": %.3f, "
+		    "\"encryptSeconds\": %.3f, \"decryptSeconds\": %.3f, "
+		    "\"encryptBytesPerSecond\": %.0f, \"decryptBytesPerSecond\": %.0f, \"cipherBytes\": %" PRIu64 ", "
+		    "\"blocks\": %" PRIu64 ", "
+		    "\"encryptBlockUs\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}, "
+		    "\"decryptBlockUs\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}%s\n",
+		    result->keySize, result->verified, result->keygenSeconds,
+		    result->encryptSeconds, result->decryptSeconds,
+		    corpusSize / result->encryptSeconds, corpusSize / result->decryptSeconds, result->cipherBytes,
+		    result->blocks,
+		    result->encryptPercentiles[0], result->encryptPercentiles[1],
+		    result->encryptPercentiles[2], result->encryptPercentiles[3],
+		    result->decryptPercentiles[0], result->decryptPercentiles[1],
+		    result->decryptPercentiles[2], result->decryptPercentiles[3],
+		    k + 1 < count ? "," : ""
+		);
+	}
+	fprintf(out, "]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+	const char* sizes = "512,1024";
+	const char* outputPath = 0;
+	uint64_t seed = 1;
+	int option;
+	while ((option = getopt(argc, argv, "s:n:j:kBd:S:o:")) != -1) {
+		if (option == 's') {
+			sizes = optarg;
+		} else if (option == 'n') {
+			corpusSize = strtoull(optarg, 0, 10);
+		} else if (option == 'j') {
+			threads = optarg;
+		} else if (option == 'k') {
+			hybridMode = 1;
+		} else if (option == 'B') {
+			useBundles = 1;
+		} else if (option == 'd') {
+			toolDirectory = optarg;
+		} else if (option == 'S') {
+			seed = strtoull(optarg, 0, 10);
+		} else if (option == 'o') {
+			outputPath = optarg;
+		} else {
+			argc = 0;
+		}
+	}
+	if (argc == 0 || corpusSize == 0) {
+		printf("Usage: %s [options]\n", argv[0]);
+		printf("\t-s\tcomma-separated key sizes in bits (default 512,1024)\n");
+		printf("\t-n\tbytes of synthetic plaintext (default 65536)\n");
+		printf("\t-j\tthreads for encryptor and decryptor (default 1)\n");
+		printf("\t-k\trun the tools in hybrid mode\n");
+		printf("\t-B\tconvert the keys to bundles before using them\n");
+		printf("\t-d\tdirectory holding the tools (default .)\n");
+		printf("\t-S\tseed for the corpus (default 1)\n");
+		printf("\t-o\twrite the results as JSON to this file\n");
+		return 1;
+	}
+	if (!mkdtemp(scratch)) {
+		printf("Couldn't make a scratch directory.\n");
+		return 2;
+	}
+	uint8_t* corpus = malloc(corpusSize);
+	makeCorpus(corpus, corpusSize, seed);
+	char corpusPath[PATH_SIZE];
+	scratchPath(corpusPath, "corpus");
+	FILE* file = fopen(corpusPath, "wb");
+	if (!file || fwrite(corpus, 1, corpusSize, file) != corpusSize) {
+		printf("Couldn't write the corpus.\n");
+		return 2;
+	}
+	fclose(file);
+	uint64_t resultCapacity = 8;
+	uint64_t resultCount = 0;
+	struct endToEndResult* results = malloc(resultCapacity * sizeof * results);
+	uint32_t failed = 0;
+	printf(
+	    "%6s %9s %12s %12s %10s %10s %10s %10s %s\n",
+	    "bits", "keygen s", "enc B/s", "dec B/s", "enc p50us", "enc p99us", "dec p50us", "dec p99us", "verified"
+	);
+	const char* size = sizes;
+	while (*size) {
+		uint64_t keySize = strtoull(size, 0, 10);
+		size += strcspn(size, ",");
+		size += *size == ',';
+		if (keySize < 64) {
+			continue;
+		}
+		if (resultCount == resultCapacity) {
+			resultCapacity *= 2;
+			results = realloc(results, resultCapacity * sizeof * results);
+		}
+		struct endToEndResult* result = &results[resultCount];
+		if (measureKeySize(keySize, corpus, result)) {
+			failed = 1;
+			break;
+		}
+		resultCount++;
+		failed |= !result->verified;
+		printf(
+		    "%6" PRIu64 " %9.2f %12.0f %12.0f %10.1f %10.1f %10.1f %10.1f %s\n",
+		    keySize, result->keygenSeconds,
+		    corpusSize / result->encryptSeconds, corpusSize / result->decryptSeconds,
+		    result->encryptPercentiles[0], result->encryptPercentiles[1],
+		    result->decryptPercentiles[0], result->decryptPercentiles[1],
+		    result->verified ? "yes" : "NO"
+		);
+		fflush(stdout);
+	}
+	if (outputPath) {
+		FILE* out = fopen(outputPath, "w");
+		if (!out) {
+			printf("Couldn't open the output file.\n");
+			return 2;
+		}
+		writeJson(out, results, resultCount);
+		fclose(out);
+	}
+	const char* names[] = {"private", "public", "private.b", "public.b", "corpus", "cipher", "output"};
+	uint64_t k;
+	for (k = 0; k < sizeof names / sizeof * names; k++) {
+		char path[PATH_SIZE];
+		scratchPath(path, names[k]);
+		unlink(path);
+	}
+	rmdir(scratch);
+	free(corpus);
+	free(results);
+	return failed ? 3 : 0;
+}
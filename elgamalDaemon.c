@@ -0,0 +1,435 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "intChain.h"
+#include "elgamal.h"
+
+// Requests and responses over the socket (little-endian):
+//  Request: operation (8 bits), flags (8 bits), reserved (16 bits), payload length (32 bits), payload.
+//  Response: status (32 bits), payload length (32 bits), payload.
+#define FRAME_HEADER_SIZE 8
+#define OP_ENCRYPT 'E'
+#define OP_DECRYPT 'D'
+#define OP_STATS 'S'
+#define REQUEST_HYBRID 0x01
+
+// Response statuses:
+//  Statuses 2 to 4 are those of elgamalDecryptBuffer.
+#define STATUS_OK 0
+#define STATUS_BAD_REQUEST 1
+#define STATUS_NO_RANDOMNESS 5
+
+// Largest payload accepted in one request:
+#define MAX_REQUEST (64 << 20)
+
+// Number of recent request latencies kept for the percentiles:
+#define LATENCY_SAMPLES 4096
+
+// One request waiting in, or taken from, the queue:
+//  Requests live on their connection thread's stack; the worker fills in the result and signals finished.
+struct request {
+	uint8_t operation;
+	uint8_t flags;
+	uint8_t* data;
+	uint64_t length;
+	uint8_t* result;
+	uint64_t resultLength;
+	uint32_t status;
+	uint32_t done;
+	uint64_t enqueued;          // monotonic nanoseconds
+	pthread_cond_t finished;
+	struct request* next;
+};
+
+// Requests from every connection, served by the worker threads in batches:
+//  A worker takes its share of what is queued, up to batchLimit, in one lock round-trip, so under load the cost of
+//  waking is spread over the batch instead of paid per request. The share is the queue split evenly over the
+//  workers, so one worker never holds requests that idle ones could be serving, and each request is answered as
+//  soon as it is served rather than when its whole batch is.
+static struct requestQueue {
+	pthread_mutex_t lock;
+	pthread_cond_t work;        // signalled when a request is queued
+	struct request* head;
+	struct request* tail;
+	uint64_t depth;             // requests queued and not yet taken
+	uint64_t peakDepth;
+	uint64_t served;
+	uint64_t batches;
+	uint64_t largestBatch;
+	uint64_t latencies[LATENCY_SAMPLES];    // nanoseconds, the most recent ones by served % LATENCY_SAMPLES
+} queue;
+
+static struct elgamalPublic* publicKey;
+static struct elgamalPrivate* privateKey;
+static uint32_t workerCount = 1;
+static uint32_t batchLimit = 16;
+
+static uint64_t monotonicNanoseconds(
+    void
+) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void putLittle32(
+    uint8_t* buffer,
+    uint32_t value
+) {
+	uint32_t k;
+	for (k = 0; k < 4; k++) {
+		buffer[k] = value >> (8 * k);
+	}
+}
+
+static uint32_t getLittle32(
+    const uint8_t* buffer
+) {
+	return buffer[0] | (uint32_t) buffer[1] << 8 | (uint32_t) buffer[2] << 16 | (uint32_t) buffer[3] << 24;
+}
+
+// Read or write exactly length bytes:
+//  Return 0 on success, or 1 if the connection ended or failed first.
+static uint32_t readFully(
+    int connection,
+    uint8_t* buffer,
+    uint64_t length
+) {
+	while (length) {
+		ssize_t got = read(connection, buffer, length);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return 1;
+		}
+		buffer += got;
+		length -= got;
+	}
+	return 0;
+}
+
+static uint32_t writeFully(
+    int connection,
+    const uint8_t* buffer,
+    uint64_t length
+) {
+	while (length) {
+		// A client that hangs up early mustn't take the daemon down with SIGPIPE:
+		ssize_t sent = send(connection, buffer, length, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return 1;
+		}
+		buffer += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+static uint32_t writeResponse(
+    int connection,
+    uint32_t status,
+    const uint8_t* data,
+    uint64_t length
+) {
+	uint8_t header[FRAME_HEADER_SIZE];
+	putLittle32(header, status);
+	putLittle32(header + 4, length);
+	return writeFully(connection, header, FRAME_HEADER_SIZE) || writeFully(connection, data, length);
+}
+
+static void serveRequest(
+    struct request* request
+) {
+	request->result = 0;
+	request->resultLength = 0;
+	request->status = STATUS_OK;
+	if (request->operation == OP_ENCRYPT) {
+		uint32_t flags = request->flags & REQUEST_HYBRID ? ELGAMAL_HYBRID : 0;
+		request->result = elgamalEncryptBuffer(publicKey, request->data, request->length, flags, &request->resultLength);
+		if (!request->result) {
+			request->status = STATUS_NO_RANDOMNESS;
+		}
+	} else if (request->operation == OP_DECRYPT && privateKey) {
+		request->result = elgamalDecryptBuffer(
+		    privateKey, request->data, request->length, &request->resultLength, &request->status
+		);
+	} else {
+		request->status = STATUS_BAD_REQUEST;
+	}
+}
+
+static void* workerThread(
+    void* argument
+) {
+	(void) argument;
+	struct request** batch = malloc(batchLimit * sizeof * batch);
+	pthread_mutex_lock(&queue.lock);
+	while (1) {
+		while (!queue.head) {
+			pthread_cond_wait(&queue.work, &queue.lock);
+		}
+		uint64_t share = (queue.depth + workerCount - 1) / workerCount;
+		if (share > batchLimit) {
+			share = batchLimit;
+		}
+		uint64_t count = 0;
+		while (queue.head && count < share) {
+			batch[count++] = queue.head;
+			queue.head = queue.head->next;
+		}
+		if (!queue.head) {
+			queue.tail = 0;
+		} else {
+			// Leave the rest to another worker:
+			pthread_cond_signal(&queue.work);
+		}
+		queue.depth -= count;
+		queue.batches++;
+		if (count > queue.largestBatch) {
+			queue.largestBatch = count;
+		}
+		pthread_mutex_unlock(&queue.lock);
+		uint64_t k;
+		for (k = 0; k < count; k++) {
+			serveRequest(batch[k]);
+			uint64_t latency = monotonicNanoseconds() - batch[k]->enqueued;
+			pthread_mutex_lock(&queue.lock);
+			queue.latencies[queue.served++ % LATENCY_SAMPLES] = latency;
+			batch[k]->done = 1;
+			pthread_cond_signal(&batch[k]->finished);
+			if (k + 1 < count) {
+				pthread_mutex_unlock(&queue.lock);
+			}
+		}
+	}
+	return 0;
+}
+
+static int compareLatencies(
+    const void* a,
+    const void* b
+) {
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+// Describe the queue and the latency percentiles of recent requests as text:
+//  Returns a newly allocated string, or 0 if it couldn't be allocated.
+static char* describeStats(
+    void
+) {
+	uint64_t* samples = malloc(LATENCY_SAMPLES * sizeof * samples);
+	pthread_mutex_lock(&queue.lock);
+	uint64_t served = queue.served;
+	uint64_t batches = queue.batches;
+	uint64_t largestBatch = queue.largestBatch;
+	uint64_t depth = queue.depth;
+	uint64_t peakDepth = queue.peakDepth;
+	uint64_t count = served < LATENCY_SAMPLES ? served : LATENCY_SAMPLES;
+	memcpy(samples, queue.latencies, count * sizeof * samples);
+	pthread_mutex_unlock(&queue.lock);
+	qsort(samples, count, sizeof * samples, compareLatencies);
+	double percentiles[4] = {0};
+	if (count) {
+		percentiles[0] = samples[count / 2] / 1e6;
+		percentiles[1] = samples[count * 9 / 10] / 1e6;
+		percentiles[2] = samples[count * 99 / 100] / 1e6;
+		percentiles[3] = samples[count - 1] / 1e6;
+	}
+	free(samples);
+	char* text;
+	size_t length;
+	FILE* stream = open_memstream(&text, &length);
+	if (!stream) {
+		return 0;
+	}
+	fprintf(
+	    stream,
+	    "served %" PRIu64 "\nbatches %" PRIu64 "\nlargestBatch %" PRIu64 "\n"
+	    "queueDepth %" PRIu64 "\npeakQueueDepth %" PRIu64 "\n"
+	    "p50Ms %.3f\np90Ms %.3f\np99Ms %.3f\nmaxMs %.3f\n",
+	    served, batches, largestBatch, depth, peakDepth,
+	    percentiles[0], percentiles[1], percentiles[2], percentiles[3]
+	);
+	struct intStats counters;
+	intReadStats(&counters);
+	if (counters.enabled) {
+		// Built with intChain's counters; add them, covering every worker thread.
+		intWriteStats(stream);
+	}
+	fclose(stream);
+	return text;
+}
+
+// Queue a request and wait for a worker to serve it:
+static void submitRequest(
+    struct request* request
+) {
+	request->done = 0;
+	request->next = 0;
+	request->enqueued = monotonicNanoseconds();
+	pthread_mutex_lock(&queue.lock);
+	if (queue.tail) {
+		queue.tail->next = request;
+	} else {
+		queue.head = request;
+	}
+	queue.tail = request;
+	if (++queue.depth > queue.peakDepth) {
+		queue.peakDepth = queue.depth;
+	}
+	pthread_cond_signal(&queue.work);
+	while (!request->done) {
+		pthread_cond_wait(&request->finished, &queue.lock);
+	}
+	pthread_mutex_unlock(&queue.lock);
+}
+
+// Serve one client connection until it hangs up:
+//  Requests on a connection are answered in order, one at a time.
+static void* connectionThread(
+    void* argument
+) {
+	int connection = (int)(intptr_t) argument;
+	struct request request;
+	pthread_cond_init(&request.finished, 0);
+	uint8_t header[FRAME_HEADER_SIZE];
+	while (!readFully(connection, header, FRAME_HEADER_SIZE)) {
+		request.operation = header[0];
+		request.flags = header[1];
+		request.length = getLittle32(header + 4);
+		if (request.length > MAX_REQUEST) {
+			writeResponse(connection, STATUS_BAD_REQUEST, 0, 0);
+			break;
+		}
+		request.data = malloc(request.length + 1);
+		if (readFully(connection, request.data, request.length)) {
+			free(request.data);
+			break;
+		}
+		uint32_t failed;
+		if (request.operation == OP_STATS) {
+			// Answered right here, so stats stay available however long the queue is.
+			char* text = describeStats();
+			failed = writeResponse(connection, text ? STATUS_OK : STATUS_BAD_REQUEST, (uint8_t*) text, text ? strlen(text) : 0);
+			free(text);
+		} else {
+			submitRequest(&request);
+			failed = writeResponse(connection, request.status, request.result, request.resultLength);
+			free(request.result);
+		}
+		free(request.data);
+		if (failed) {
+			break;
+		}
+	}
+	close(connection);
+	pthread_cond_destroy(&request.finished);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int option;
+	while ((option = getopt(argc, argv, "j:b:")) != -1) {
+		if (option == 'j') {
+			workerCount = strtoul(optarg, 0, 10);
+			if (workerCount == 0) {
+				workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+		} else if (option == 'b') {
+			batchLimit = strtoul(optarg, 0, 10);
+			if (batchLimit == 0) {
+				batchLimit = 1;
+			}
+		} else {
+			argc = 0;
+		}
+	}
+	if (argc - optind < 2) {
+		printf("Usage: %s [-j threads] [-b batch] socketPath publicKeyFile [privateKeyFile]\n", argv[0]);
+		printf("\t-j\tserve requests on this many threads, or 0 for one per core (default 1)\n");
+		printf("\t-b\ttake up to this many queued requests at once (default 16)\n");
+		return 1;
+	}
+	argv += optind - 1;
+	argc -= optind - 1;
+	uint32_t status;
+	publicKey = elgamalPublicLoad(argv[2], &status);
+	if (status == 1) {
+		printf("Couldn't open publicKeyFile.");
+		return 2;
+	} else if (status) {
+		printf("The public key file is improperly formatted.\n");
+		return 3;
+	}
+	if (argc > 3) {
+		privateKey = elgamalPrivateLoad(argv[3], &status);
+		if (status == 1) {
+			printf("Couldn't open privateKeyFile.");
+			return 2;
+		} else if (status) {
+			printf("The private key file is improperly formatted.\n");
+			return 3;
+		}
+		if (elgamalPrivateKeyId(privateKey) != elgamalPublicKeyId(publicKey)) {
+			printf("The private key doesn't match the public key.\n");
+			return 3;
+		}
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof address);
+	address.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof address.sun_path) {
+		printf("The socket path is too long.\n");
+		return 4;
+	}
+	strcpy(address.sun_path, argv[1]);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	// A socket left behind by an earlier run would make bind fail:
+	unlink(argv[1]);
+	if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof address) || listen(listener, SOMAXCONN)) {
+		printf("Couldn't listen on %s: %s\n", argv[1], strerror(errno));
+		return 4;
+	}
+	pthread_mutex_init(&queue.lock, 0);
+	pthread_cond_init(&queue.work, 0);
+	uint32_t k;
+	for (k = 0; k < workerCount; k++) {
+		pthread_t worker;
+		pthread_create(&worker, 0, workerThread, 0);
+		pthread_detach(worker);
+	}
+	printf("Listening on %s\n", argv[1]);
+	fflush(stdout);
+	while (1) {
+		int connection = accept(listener, 0, 0);
+		if (connection < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			printf("Failed to accept a connection: %s\n", strerror(errno));
+			return 5;
+		}
+		pthread_t thread;
+		if (pthread_create(&thread, 0, connectionThread, (void*)(intptr_t) connection)) {
+			close(connection);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
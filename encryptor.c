@@ -1,96 +1,417 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "intChain.h"
+#include "cipherText.h"
+#include "chacha.h"
+#include "elgamal.h"
+#include "batchFiles.h"
 
+// The loaded key:
+//  Contexts are read-only, so every worker thread shares this one.
+static struct elgamalPublic* publicKey;
 static uint64_t keySize;
-static struct intChain* PrimeModulus;
-static struct intChain* Generator;
-static struct intChain* Exponential;
+
+// Write the legacy hex format instead of the binary container:
+static uint32_t hexOutput;
+// Encapsulate one session key with ElGamal and stream-encrypt the data under it:
+static uint32_t hybridMode;
+// Encrypt many files with the key loaded once:
+static uint32_t batchMode;
+static struct cipherHeader header;
+
+// Plaintext bytes per block:
+//  The legacy hex format keeps intEncodeString's keySize/16 bytes, so that older decryptors can read it.
+static uint64_t blockCapacity;
+
+// Size of the chunks read from stdin at a time:
+#define INPUT_CHUNK (1 << 20)
+
+// Number of blocks the pipeline may hold per worker thread:
+#define SLOTS_PER_WORKER 4
 
 FILE* fp;
 
-static void encryptWord(
+// One block's place in the pipeline:
+struct pipelineSlot {
+	uint8_t* data;
+	uint64_t length;
+	uint32_t done;
+	struct intChain* ScrambleCipher;
+	struct intChain* WordCipher;
+};
+
+// Reader -> workers -> writer pipeline:
+//  Block k lives in slot k % slotCount from when it is read until it is written,
+//  so the writer emits blocks in their original order however the workers finish.
+static struct pipeline {
+	pthread_mutex_t lock;
+	pthread_cond_t space;   // signalled when the writer frees a slot
+	pthread_cond_t work;    // signalled when the reader fills a slot
+	pthread_cond_t done;    // signalled when a worker finishes a slot
+	struct pipelineSlot* slots;
+	uint64_t slotCount;
+	uint64_t read;          // blocks handed over by the reader
+	uint64_t claimed;       // blocks taken by workers
+	uint64_t written;       // blocks written out
+	uint32_t finished;      // set once the reader has reached the end of stdin
+} pipeline;
+
+static uint32_t workerCount = 1;
+
+static struct intChain* encodeBlock(
+    const uint8_t* data,
+    uint64_t length,
     char* word
 ) {
-	struct intChain* IntWord = intEncodeString(word);
-	struct intChain* Scramble = intCryptoRandom(PrimeModulus);
-	struct intChain* ScrambleCipher = intModExp(Generator, Scramble, PrimeModulus);
-	struct intChain* ScrambledExponential = intModExp(Exponential, Scramble, PrimeModulus);
-	struct intChain* WordCipher = intMult(IntWord, ScrambledExponential);
-	intMod(WordCipher, PrimeModulus);
-	char* ScrambleCipherString = intToString(ScrambleCipher);
-	char* WordCipherString = intToString(WordCipher);
-	fprintf(fp, "%s\n%s\n\n", ScrambleCipherString, WordCipherString);
-	free(ScrambleCipherString);
-	free(WordCipherString);
+	if (hexOutput) {
+		memset(word, 0, blockCapacity + 1);
+		memcpy(word, data, length);
+		return intEncodeString(word);
+	}
+	return cipherPackBlock(data, length, keySize);
+}
+
+static void encryptBlock(
+    const uint8_t* data,
+    uint64_t length,
+    char* word,
+    struct intChain** ScrambleCipher,
+    struct intChain** WordCipher
+) {
+	struct intChain* IntWord = encodeBlock(data, length, word);
+	elgamalEncryptWord(publicKey, IntWord, ScrambleCipher, WordCipher);
 	intFree(IntWord);
-	intFree(Scramble);
+}
+
+static void writeWord(
+    struct intChain* ScrambleCipher,
+    struct intChain* WordCipher
+) {
+	if (hexOutput) {
+		// Both numbers are below the modulus, so their strings fit in buffers sized from the key:
+		static char* ScrambleCipherString;
+		static char* WordCipherString;
+		if (!ScrambleCipherString) {
+			ScrambleCipherString = malloc(17 * cipherLimbs(keySize) + 2);
+			WordCipherString = malloc(17 * cipherLimbs(keySize) + 2);
+		}
+		intWriteString(ScrambleCipher, ScrambleCipherString);
+		intWriteString(WordCipher, WordCipherString);
+		fprintf(fp, "%s\n%s\n\n", ScrambleCipherString, WordCipherString);
+	} else if (cipherWriteBlock(fp, &header, ScrambleCipher, WordCipher)) {
+		printf("Failed to write a ciphertext block.\n");
+		exit(7);
+	}
 	intFree(ScrambleCipher);
-	intFree(ScrambledExponential);
 	intFree(WordCipher);
 }
 
-static uint32_t readWord(
+static void* workerThread(
+    void* argument
+) {
+	(void) argument;
+	char* word = malloc(blockCapacity + 1);
+	pthread_mutex_lock(&pipeline.lock);
+	while (1) {
+		while (pipeline.claimed == pipeline.read && !pipeline.finished) {
+			pthread_cond_wait(&pipeline.work, &pipeline.lock);
+		}
+		if (pipeline.claimed == pipeline.read) {
+			break;
+		}
+		struct pipelineSlot* slot = &pipeline.slots[pipeline.claimed++ % pipeline.slotCount];
+		pthread_mutex_unlock(&pipeline.lock);
+		encryptBlock(slot->data, slot->length, word, &slot->ScrambleCipher, &slot->WordCipher);
+		pthread_mutex_lock(&pipeline.lock);
+		slot->done = 1;
+		pthread_cond_signal(&pipeline.done);
+	}
+	pthread_mutex_unlock(&pipeline.lock);
+	free(word);
+	intClearPool();
+	return 0;
+}
+
+static void* writerThread(
+    void* argument
+) {
+	(void) argument;
+	pthread_mutex_lock(&pipeline.lock);
+	while (1) {
+		struct pipelineSlot* slot = &pipeline.slots[pipeline.written % pipeline.slotCount];
+		while (pipeline.written < pipeline.read && !slot->done) {
+			pthread_cond_wait(&pipeline.done, &pipeline.lock);
+		}
+		if (pipeline.written == pipeline.read) {
+			if (pipeline.finished) {
+				break;
+			}
+			pthread_cond_wait(&pipeline.done, &pipeline.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pipeline.lock);
+		writeWord(slot->ScrambleCipher, slot->WordCipher);
+		pthread_mutex_lock(&pipeline.lock);
+		slot->done = 0;
+		pipeline.written++;
+		pthread_cond_signal(&pipeline.space);
+	}
+	pthread_mutex_unlock(&pipeline.lock);
+	intClearPool();
+	return 0;
+}
+
+// Encrypt one block, either right away or by handing it to the pipeline:
+static void submitBlock(
+    const uint8_t* data,
+    uint64_t length,
     char* word
 ) {
-	uint32_t stillReading = 1;
-	uint32_t k = 0;
-	while (k < keySize / 16) {
-		char c = getchar();
-		if (c == EOF) {
-			stillReading = 0;
+	if (workerCount == 1) {
+		struct intChain* ScrambleCipher;
+		struct intChain* WordCipher;
+		encryptBlock(data, length, word, &ScrambleCipher, &WordCipher);
+		writeWord(ScrambleCipher, WordCipher);
+		return;
+	}
+	pthread_mutex_lock(&pipeline.lock);
+	while (pipeline.read - pipeline.written == pipeline.slotCount) {
+		pthread_cond_wait(&pipeline.space, &pipeline.lock);
+	}
+	struct pipelineSlot* slot = &pipeline.slots[pipeline.read % pipeline.slotCount];
+	pthread_mutex_unlock(&pipeline.lock);
+	// The slot is free, and nobody else touches it until it is published below.
+	memcpy(slot->data, data, length);
+	slot->length = length;
+	pthread_mutex_lock(&pipeline.lock);
+	pipeline.read++;
+	pthread_cond_signal(&pipeline.work);
+	pthread_mutex_unlock(&pipeline.lock);
+}
+
+// Encapsulate a fresh session key in one ElGamal block, then stream-encrypt stdin under it:
+//  The tag written after the payload covers the header and the session block too.
+//  Returns 0 on success, or 1 if the session key or the payload couldn't be produced.
+static uint32_t encryptHybrid(
+    void
+) {
+	uint8_t session[ELGAMAL_SESSION_SIZE];
+	struct intChain* ScrambleCipher;
+	struct intChain* WordCipher;
+	if (elgamalEncapsulate(publicKey, session, &ScrambleCipher, &WordCipher)) {
+		return 1;
+	}
+	uint64_t aadLength = CIPHER_HEADER_SIZE + 16 * header.limbs;
+	uint8_t* aad = malloc(aadLength);
+	cipherPutHeader(aad, &header);
+	cipherPutBlock(aad + CIPHER_HEADER_SIZE, header.limbs, ScrambleCipher, WordCipher);
+	writeWord(ScrambleCipher, WordCipher);
+	struct chachaSeal cipher;
+	chachaSealInit(&cipher, session, session + CHACHA_KEY_SIZE, aad, aadLength);
+	memset(session, 0, sizeof session);
+	free(aad);
+	uint8_t* buffer = malloc(INPUT_CHUNK);
+	uint32_t status = 0;
+	size_t got;
+	while ((got = fread(buffer, 1, INPUT_CHUNK, stdin)) > 0) {
+		if (chachaSealEncrypt(&cipher, buffer, buffer, got) || fwrite(buffer, 1, got, fp) != got) {
+			status = 1;
 			break;
 		}
-		word[k++] = c;
 	}
-	encryptWord(word);
-	return stillReading;
+	if (ferror(stdin)) {
+		status = 1;
+	}
+	uint8_t tag[CHACHA_TAG_SIZE];
+	chachaSealFinish(&cipher, tag);
+	if (fwrite(tag, 1, sizeof tag, fp) != sizeof tag) {
+		status = 1;
+	}
+	memset(&cipher, 0, sizeof cipher);
+	free(buffer);
+	return status;
+}
+
+// Encrypt one file's contents for batch mode:
+static uint8_t* encryptFile(
+    const uint8_t* data,
+    uint64_t length,
+    uint64_t* resultLength,
+    const char* path
+) {
+	uint8_t* result = elgamalEncryptBuffer(publicKey, data, length, hybridMode ? ELGAMAL_HYBRID : 0, resultLength);
+	if (!result) {
+		printf("Failed to encrypt %s.\n", path);
+	}
+	return result;
 }
 
 int main(int argc, char* argv[]) {
-	if (argc < 3) {
-		printf("Usage: %s publicKeyFile cipherTextFile\n", argv[0]);
+	int option;
+	uint32_t threadsGiven = 0;
+	while ((option = getopt(argc, argv, "xkbj:")) != -1) {
+		if (option == 'x') {
+			hexOutput = 1;
+		} else if (option == 'k') {
+			hybridMode = 1;
+		} else if (option == 'b') {
+			batchMode = 1;
+		} else if (option == 'j') {
+			threadsGiven = 1;
+			workerCount = strtoul(optarg, 0, 10);
+			if (workerCount == 0) {
+				workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+		} else {
+			argc = 0;
+		}
+	}
+	// A single hybrid stream is one keystream, so only batch mode can spread it over threads:
+	if (
+	    argc - optind < 2 + (int) batchMode || (hexOutput && (hybridMode || batchMode)) ||
+	    (hybridMode && threadsGiven && !batchMode)
+	) {
+		printf("Usage: %s [-x | -k] [-j threads] publicKeyFile cipherTextFile\n", argv[0]);
+		printf("       %s -b [-k] [-j threads] publicKeyFile sourceDirectoryOrManifest destinationDirectory\n", argv[0]);
+		printf("\t-x\twrite the legacy hex format instead of the binary container\n");
+		printf("\t-k\tencrypt a session key with ElGamal and the data with ChaCha20\n");
+		printf("\t-b\tencrypt every file of a directory, or listed in a manifest, into the destination directory\n");
+		printf("\t-j\tencrypt on this many threads, or 0 for one per core (default 1); with -k, batch mode only\n");
 		return 1;
 	}
-	fp = fopen(argv[1], "r");
-	if(fp == 0) {
+	argv += optind - 1;
+	uint32_t status;
+	publicKey = elgamalPublicLoad(argv[1], &status);
+	if (status == 1) {
 		printf("Couldn't open publicKeyFile.");
 		return 2;
-	}
-	keySize = 0;
-	if (fscanf(fp, "%*12[^/]%lu", &keySize) != 1) {
-		printf("The public key file is improperly formatted. %lu\n", keySize);
-		return 3;
-	}
-	char* string = malloc((keySize / 64 + 1) * 17 + 1);
-	if (fscanf(fp, "%*22[^/]%[^\n]", string) != 1) {
+	} else if (status) {
 		printf("The public key file is improperly formatted.\n");
-		return 4;
+		return 3;
 	}
-	PrimeModulus = intFromString(string);
-	if (fscanf(fp, "%*13[^/]%[^\n]", string) != 1) {
-		printf("The public key file is improperly formatted.\n");
-		return 5;
+	keySize = elgamalPublicKeySize(publicKey);
+	char* string = malloc(keySize / 16 + 1);
+	if (hybridMode && elgamalPublicCapacity(publicKey) < ELGAMAL_SESSION_SIZE) {
+		printf("The key is too small to carry a session key.\n");
+		return 8;
 	}
-	Generator = intFromString(string);
-	if (fscanf(fp, "%*15[^/]%[^\n]", string) != 1) {
-		printf("The public key file is improperly formatted.\n");
-		return 6;
+	if (batchMode) {
+		char** inputs;
+		char** outputs;
+		uint64_t count;
+		if (batchList(argv[2], argv[3], &inputs, &outputs, &count)) {
+			printf("Couldn't read the batch source.\n");
+			return 2;
+		}
+		uint64_t failures = batchRun(inputs, outputs, count, workerCount, encryptFile);
+		batchFreeList(inputs, outputs, count);
+		free(string);
+		elgamalPublicFree(publicKey);
+		if (failures) {
+			printf("%" PRIu64 " of %" PRIu64 " files failed.\n", failures, count);
+			return 7;
+		}
+		return 0;
 	}
-	Exponential = intFromString(string);
-	fclose(fp);
 	fp = fopen(argv[2], "w");
-	memset(string, 0, keySize * 17 / 64 + 2);
-	while (readWord(string)) {
-		memset(string, 0, keySize * 17 / 64 + 2);
-	};
+	if (fp == 0) {
+		printf("Couldn't open cipherTextFile.");
+		return 2;
+	}
+	if (!hexOutput) {
+		header.version = CIPHER_VERSION;
+		header.flags = CIPHER_DENSE | (hybridMode ? CIPHER_HYBRID : 0);
+		header.keySize = keySize;
+		header.limbs = cipherLimbs(keySize);
+		header.keyId = elgamalPublicKeyId(publicKey);
+		if (cipherWriteHeader(fp, &header)) {
+			printf("Failed to write the ciphertext header.\n");
+			return 7;
+		}
+	}
+	if (hybridMode) {
+		status = encryptHybrid();
+		fclose(fp);
+		free(string);
+		elgamalPublicFree(publicKey);
+		if (status) {
+			printf("Failed to encrypt the payload.\n");
+			return 7;
+		}
+		return 0;
+	}
+	blockCapacity = hexOutput ? keySize / 16 : elgamalPublicCapacity(publicKey);
+	// Read stdin in large chunks and slice them into blocks:
+	//  Up to one partial block is carried over in front of each new chunk.
+	uint8_t* input = malloc(INPUT_CHUNK + blockCapacity);
+	pthread_t* workers = 0;
+	pthread_t writer;
+	if (workerCount > 1) {
+		pthread_mutex_init(&pipeline.lock, 0);
+		pthread_cond_init(&pipeline.space, 0);
+		pthread_cond_init(&pipeline.work, 0);
+		pthread_cond_init(&pipeline.done, 0);
+		pipeline.slotCount = SLOTS_PER_WORKER * workerCount;
+		pipeline.slots = calloc(pipeline.slotCount, sizeof * pipeline.slots);
+		uint64_t k;
+		for (k = 0; k < pipeline.slotCount; k++) {
+			pipeline.slots[k].data = malloc(blockCapacity);
+		}
+		workers = malloc(workerCount * sizeof * workers);
+		for (k = 0; k < workerCount; k++) {
+			pthread_create(&workers[k], 0, workerThread, 0);
+		}
+		pthread_create(&writer, 0, writerThread, 0);
+	}
+	uint64_t filled = 0;
+	size_t got;
+	while ((got = fread(input + filled, 1, INPUT_CHUNK, stdin)) > 0) {
+		filled += got;
+		uint8_t* data = input;
+		while (filled >= blockCapacity) {
+			submitBlock(data, blockCapacity, string);
+			data += blockCapacity;
+			filled -= blockCapacity;
+		}
+		memmove(input, data, filled);
+	}
+	uint32_t readError = ferror(stdin);
+	if (filled || hexOutput) {
+		// The legacy format always ends with a partial (possibly empty) block.
+		submitBlock(input, filled, string);
+	}
+	if (workerCount > 1) {
+		// Let the pipeline drain:
+		pthread_mutex_lock(&pipeline.lock);
+		pipeline.finished = 1;
+		pthread_cond_broadcast(&pipeline.work);
+		pthread_cond_broadcast(&pipeline.done);
+		pthread_mutex_unlock(&pipeline.lock);
+		uint64_t k;
+		for (k = 0; k < workerCount; k++) {
+			pthread_join(workers[k], 0);
+		}
+		pthread_join(writer, 0);
+		for (k = 0; k < pipeline.slotCount; k++) {
+			free(pipeline.slots[k].data);
+		}
+		free(pipeline.slots);
+		free(workers);
+	}
 	fclose(fp);
+	free(input);
 	free(string);
-	intFree(PrimeModulus);
-	intFree(Generator);
-	intFree(Exponential);
+	elgamalPublicFree(publicKey);
+	if (readError) {
+		printf("Failed to read the plaintext.\n");
+		return 7;
+	}
 	return 0;
 }
@@ -0,0 +1,654 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "intChain.h"
+
+// Micro-benchmarks for the intChain primitives:
+//  Every operation is timed at every size in the sweep. A calibration pass doubles as warm-up; then each of
+//  the repetitions runs the operation enough times to fill the target time, giving one ns/op sample.
+
+// Largest batch of prepared operands for the operations that consume their input:
+#define MAX_PREPARED 4096
+
+// Longest line expected in a baseline file:
+#define LINE_SIZE 512
+
+// Hardware counters read around every repetition through perf_event_open:
+//  Any the kernel or machine doesn't offer stay closed and are reported as unavailable.
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_L1_MISSES 2
+#define COUNTER_LLC_MISSES 3
+#define COUNTER_BRANCH_MISSES 4
+#define COUNTER_DTLB_MISSES 5
+#define COUNTERS 6
+
+// Cache events are encoded as cache | operation << 8 | result << 16:
+#define CACHE_READ_MISS(cache) \
+	((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+// Operands for one size:
+struct benchState {
+	uint64_t bits;
+	struct intChain* X;
+	struct intChain* Y;
+	struct intChain* Modulus;       // odd, of the same size as X and Y
+	struct intChain* Product;       // X * Y, for the reductions
+	struct intChain* Candidate;     // odd, for intIsPrime
+	struct intChain* Accumulator;   // grown by intAdd and shrunk by intSub across runs
+	struct intChain** prepared;     // fresh operands for the operations that consume them
+	char* hex;
+};
+
+// One operation under test:
+//  prepare, if set, fills prepared[0..count) before the timed loop; run performs the k-th operation.
+struct benchOp {
+	const char* name;
+	uint32_t limit;     // 0 for cheap operations, or which of the size limits applies
+	void (*prepare)(struct benchState*, uint64_t);
+	void (*run)(struct benchState*, uint64_t);
+};
+
+#define LIMIT_EXPONENTIATION 1
+#define LIMIT_PRIME_SEARCH 2
+
+// One measured result, and its baseline if there was one:
+struct benchResult {
+	const char* name;
+	uint64_t bits;
+	uint64_t iterations;
+	double medianNs;
+	double minNs;
+	double meanNs;
+	double stddevNs;
+	double cyclesPerLimb;
+	double counters[COUNTERS];  // median per operation, or -1 if unavailable
+	double baselineNs;
+};
+
+static uint64_t repetitions = 5;
+static double targetNs = 20e6;
+static uint64_t exponentiationLimit = 2048;
+static uint64_t primeSearchLimit = 512;
+static int counterFds[COUNTERS] = {-1, -1, -1, -1, -1, -1};
+static uint32_t countersOpen;
+
+static uint64_t monotonicNanoseconds(
+    void
+) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Time-stamp counter, or 0 where there is none:
+static uint64_t cycleCount(
+    void
+) {
+#if defined(__x86_64__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Open whichever hardware counters are available, counting this thread in user space:
+static void openCounters(
+    void
+) {
+	static const uint64_t events[COUNTERS][2] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+		{PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+	};
+	uint32_t k;
+	for (k = 0; k < COUNTERS; k++) {
+		struct perf_event_attr attributes;
+		memset(&attributes, 0, sizeof attributes);
+		attributes.size = sizeof attributes;
+		attributes.type = events[k][0];
+		attributes.config = events[k][1];
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		// With more counters than the PMU has, the kernel multiplexes them; these let the counts be scaled back up.
+		attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		counterFds[k] = syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+		countersOpen += counterFds[k] >= 0;
+	}
+}
+
+static void startCounters(
+    void
+) {
+	uint32_t k;
+	for (k = 0; k < COUNTERS; k++) {
+		if (counterFds[k] >= 0) {
+			ioctl(counterFds[k], PERF_EVENT_IOC_RESET, 0);
+			ioctl(counterFds[k], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+// Stop the counters and read them, scaled for multiplexing, or -1 for those unavailable:
+static void stopCounters(
+    double* values
+) {
+	uint32_t k;
+	for (k = 0; k < COUNTERS; k++) {
+		if (counterFds[k] >= 0) {
+			ioctl(counterFds[k], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+	for (k = 0; k < COUNTERS; k++) {
+		uint64_t reading[3];
+		values[k] = -1;
+		if (counterFds[k] >= 0 && read(counterFds[k], reading, sizeof reading) == sizeof reading && reading[2]) {
+			values[k] = (double) reading[0] * reading[1] / reading[2];
+		}
+	}
+}
+
+static void prepareCopies(
+    struct benchState* state,
+    uint64_t count,
+    struct intChain* Source
+) {
+	uint64_t k;
+	for (k = 0; k < count; k++) {
+		state->prepared[k] = intCopy(Source);
+	}
+}
+
+static void prepareX(
+    struct benchState* state,
+    uint64_t count
+) {
+	prepareCopies(state, count, state->X);
+}
+
+static void prepareProduct(
+    struct benchState* state,
+    uint64_t count
+) {
+	prepareCopies(state, count, state->Product);
+}
+
+static void runAdd(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intAdd(state->Accumulator, state->Y);
+}
+
+static void runSub(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intSub(state->Accumulator, state->Y);
+}
+
+static void runScale(
+    struct benchState* state,
+    uint64_t k
+) {
+	intScale(state->prepared[k], 0x9E3779B97F4A7C15);
+}
+
+static void runMult(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intFree(intMult(state->X, state->Y));
+}
+
+static void runMod(
+    struct benchState* state,
+    uint64_t k
+) {
+	intMod(state->prepared[k], state->Modulus);
+}
+
+static void runDiv(
+    struct benchState* state,
+    uint64_t k
+) {
+	intFree(intDiv(state->prepared[k], state->Modulus));
+}
+
+static void runModExp(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intFree(intModExp(state->X, state->Y, state->Modulus));
+}
+
+static void runIsPrime(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intIsPrime(state->Candidate);
+}
+
+static void runMakePrime(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intFree(intMakePrime(state->bits));
+}
+
+static void runToString(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	free(intToString(state->X));
+}
+
+static void runFromString(
+    struct benchState* state,
+    uint64_t k
+) {
+	(void) k;
+	intFree(intFromString(state->hex));
+}
+
+static const struct benchOp operations[] = {
+	{"intAdd", 0, 0, runAdd},
+	{"intSub", 0, 0, runSub},
+	{"intScale", 0, prepareX, runScale},
+	{"intMult", 0, 0, runMult},
+	{"intMod", 0, prepareProduct, runMod},
+	{"intDiv", 0, prepareProduct, runDiv},
+	{"intModExp", LIMIT_EXPONENTIATION, 0, runModExp},
+	{"intIsPrime", LIMIT_EXPONENTIATION, 0, runIsPrime},
+	{"intMakePrime", LIMIT_PRIME_SEARCH, 0, runMakePrime},
+	{"intToString", 0, 0, runToString},
+	{"intFromString", 0, 0, runFromString},
+};
+
+// Make a random intChain of exactly the given number of bits:
+static struct intChain* randomOfSize(
+    uint64_t bits
+) {
+	struct intChain* Bound = intMake();
+	intIncrement(Bound);
+	intLShift(Bound, bits - 1);
+	struct intChain* X = intPseudoRandom(Bound);
+	intAdd(X, Bound);
+	intFree(Bound);
+	return X;
+}
+
+static void setUp(
+    struct benchState* state,
+    uint64_t bits
+) {
+	state->bits = bits;
+	state->X = randomOfSize(bits);
+	state->Y = randomOfSize(bits);
+	state->Modulus = randomOfSize(bits);
+	if (intIsEven(state->Modulus)) {
+		intIncrement(state->Modulus);
+	}
+	state->Product = intMult(state->X, state->Y);
+	// Random odd candidates are what intMakePrime spends most of its time rejecting:
+	state->Candidate = randomOfSize(bits);
+	if (intIsEven(state->Candidate)) {
+		intIncrement(state->Candidate);
+	}
+	// intSub must never take the accumulator below Y, however many times it runs:
+	state->Accumulator = intCopy(state->X);
+	intLShift(state->Accumulator, 64);
+	state->prepared = malloc(MAX_PREPARED * sizeof * state->prepared);
+	state->hex = intToString(state->X);
+}
+
+static void tearDown(
+    struct benchState* state
+) {
+	intFree(state->X);
+	intFree(state->Y);
+	intFree(state->Modulus);
+	intFree(state->Product);
+	intFree(state->Candidate);
+	intFree(state->Accumulator);
+	free(state->prepared);
+	free(state->hex);
+}
+
+// Run an operation count times, returning the elapsed nanoseconds and cycles, and the hardware counters:
+static void timeRuns(
+    const struct benchOp* op,
+    struct benchState* state,
+    uint64_t count,
+    double* nanoseconds,
+    double* cycles,
+    double* counters
+) {
+	if (op->prepare) {
+		op->prepare(state, count);
+	}
+	startCounters();
+	uint64_t startCycles = cycleCount();
+	uint64_t start = monotonicNanoseconds();
+	uint64_t k;
+	for (k = 0; k < count; k++) {
+		op->run(state, k);
+	}
+	*nanoseconds = monotonicNanoseconds() - start;
+	*cycles = cycleCount() - startCycles;
+	stopCounters(counters);
+	if (op->prepare) {
+		for (k = 0; k < count; k++) {
+			intFree(state->prepared[k]);
+		}
+	}
+}
+
+static int compareDoubles(
+    const void* a,
+    const void* b
+) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static void measure(
+    const struct benchOp* op,
+    struct benchState* state,
+    struct benchResult* result
+) {
+	// Calibrate, which also warms up caches, branch predictors and the node pool:
+	uint64_t count = 1;
+	double nanoseconds;
+	double cycles;
+	double counters[COUNTERS];
+	timeRuns(op, state, count, &nanoseconds, &cycles, counters);
+	while (nanoseconds < targetNs / 2 && (!op->prepare || count < MAX_PREPARED)) {
+		count *= 2;
+		timeRuns(op, state, count, &nanoseconds, &cycles, counters);
+	}
+	double* samples = malloc(repetitions * sizeof * samples);
+	double* cycleSamples = malloc(repetitions * sizeof * cycleSamples);
+	double* counterSamples = malloc(COUNTERS * repetitions * sizeof * counterSamples);
+	uint64_t r;
+	uint32_t j;
+	result->meanNs = 0;
+	for (r = 0; r < repetitions; r++) {
+		timeRuns(op, state, count, &nanoseconds, &cycles, counters);
+		samples[r] = nanoseconds / count;
+		cycleSamples[r] = cycles / count;
+		for (j = 0; j < COUNTERS; j++) {
+			counterSamples[j * repetitions + r] = counters[j] < 0 ? -1 : counters[j] / count;
+		}
+		result->meanNs += samples[r];
+	}
+	for (j = 0; j < COUNTERS; j++) {
+		qsort(counterSamples + j * repetitions, repetitions, sizeof * counterSamples, compareDoubles);
+		result->counters[j] = counterSamples[j * repetitions + repetitions / 2];
+	}
+	free(counterSamples);
+	result->meanNs /= repetitions;
+	double variance = 0;
+	for (r = 0; r < repetitions; r++) {
+		variance += (samples[r] - result->meanNs) * (samples[r] - result->meanNs);
+	}
+	result->stddevNs = repetitions > 1 ? sqrt(variance / (repetitions - 1)) : 0;
+	qsort(samples, repetitions, sizeof * samples, compareDoubles);
+	qsort(cycleSamples, repetitions, sizeof * cycleSamples, compareDoubles);
+	result->name = op->name;
+	result->bits = state->bits;
+	result->iterations = count;
+	result->medianNs = samples[repetitions / 2];
+	result->minNs = samples[0];
+	result->cyclesPerLimb = cycleSamples[repetitions / 2] / ((state->bits + 63) / 64);
+	free(samples);
+	free(cycleSamples);
+}
+
+// Find a result's median in a baseline written by an earlier run:
+//  Results are one per line, so the baseline is scanned line by line. Returns 0 if it isn't there.
+static double findBaseline(
+    FILE* baseline,
+    const char* name,
+    uint64_t bits
+) {
+	char line[LINE_SIZE];
+	rewind(baseline);
+	while (fgets(line, LINE_SIZE, baseline)) {
+		char lineName[64];
+		uint64_t lineBits;
+		const char* field = strstr(line, "\"op\": ");
+		const char* median = strstr(line, "\"medianNs\": ");
+		if (
+		    field && median &&
+		    sscanf(field, "\"op\": \"%63[^\"]\", \"bits\": %" SCNu64, lineName, &lineBits) == 2 &&
+		    lineBits == bits && strcmp(lineName, name) == 0
+		) {
+			return strtod(median + strlen("\"medianNs\": "), 0);
+		}
+	}
+	return 0;
+}
+
+// IPC and misses per limb from a result's counters, or -1 where a counter was unavailable:
+static void derivedMetrics(
+    struct benchResult* result,
+    double* metrics     // IPC, then L1, LLC, branch and dTLB misses per limb
+) {
+	double limbs = (result->bits + 63) / 64;
+	double* counters = result->counters;
+	metrics[0] = counters[COUNTER_CYCLES] > 0 && counters[COUNTER_INSTRUCTIONS] >= 0 ?
+	    counters[COUNTER_INSTRUCTIONS] / counters[COUNTER_CYCLES] : -1;
+	uint32_t k;
+	for (k = 0; k < 4; k++) {
+		double misses = counters[COUNTER_L1_MISSES + k];
+		metrics[1 + k] = misses >= 0 ? misses / limbs : -1;
+	}
+}
+
+// Write a metric as JSON, null if it is unavailable:
+static void writeMetric(
+    FILE* out,
+    const char* name,
+    double value
+) {
+	if (value < 0) {
+		fprintf(out, ", \"%s\": null", name);
+	} else {
+		fprintf(out, ", \"%s\": %.4f", name, value);
+	}
+}
+
+static void writeJson(
+    FILE* out,
+    struct benchResult* results,
+    uint64_t count
+) {
+	fprintf(out, "{\n\"repetitions\": %" PRIu64 ",\n\"targetNs\": %.0f,\n\"results\": [\n", repetitions, targetNs);
+	uint64_t k;
+	for (k = 0; k < count; k++) {
+		struct benchResult* result = &results[k];
+		fprintf(
+		    out,
+		    "{\"op\": \"%s\", \"bits\": %" PRIu64 ", \"limbs\": %" PRIu64 ", \"iterations\": %" PRIu64 ", "
+		    "\"medianNs\": %.1f, \"minNs\": %.1f, \"meanNs\": %.1f, \"stddevNs\": %.1f, \"cyclesPerLimb\": %.2f",
+		    result->name, result->bits, (result->bits + 63) / 64, result->iterations,
+		    result->medianNs, result->minNs, result->meanNs, result->stddevNs, result->cyclesPerLimb
+		);
+		double metrics[5];
+		derivedMetrics(result, metrics);
+		writeMetric(out, "ipc", metrics[0]);
+		writeMetric(out, "l1MissesPerLimb", metrics[1]);
+		writeMetric(out, "llcMissesPerLimb", metrics[2]);
+		writeMetric(out, "branchMissesPerLimb", metrics[3]);
+		writeMetric(out, "dtlbMissesPerLimb", metrics[4]);
+		if (result->baselineNs > 0) {
+			fprintf(out, ", \"baselineNs\": %.1f, \"ratio\": %.3f", result->baselineNs, result->medianNs / result->baselineNs);
+		}
+		fprintf(out, "}%s\n", k + 1 < count ? "," : "");
+	}
+	fprintf(out, "]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+	const char* sizes = "512,1024,2048,4096,8192";
+	const char* filter = 0;
+	const char* outputPath = 0;
+	const char* baselinePath = 0;
+	double tolerance = 0.10;
+	int option;
+	while ((option = getopt(argc, argv, "s:f:r:t:e:p:o:c:x:")) != -1) {
+		if (option == 's') {
+			sizes = optarg;
+		} else if (option == 'f') {
+			filter = optarg;
+		} else if (option == 'r') {
+			repetitions = strtoull(optarg, 0, 10);
+		} else if (option == 't') {
+			targetNs = strtod(optarg, 0) * 1e6;
+		} else if (option == 'e') {
+			exponentiationLimit = strtoull(optarg, 0, 10);
+		} else if (option == 'p') {
+			primeSearchLimit = strtoull(optarg, 0, 10);
+		} else if (option == 'o') {
+			outputPath = optarg;
+		} else if (option == 'c') {
+			baselinePath = optarg;
+		} else if (option == 'x') {
+			tolerance = strtod(optarg, 0) / 100;
+		} else {
+			argc = 0;
+		}
+	}
+	if (argc == 0 || repetitions == 0) {
+		printf("Usage: %s [options]\n", argv[0]);
+		printf("\t-s\tcomma-separated key sizes in bits (default 512,1024,2048,4096,8192)\n");
+		printf("\t-f\tonly run operations whose name contains this text\n");
+		printf("\t-r\trepetitions per measurement (default 5)\n");
+		printf("\t-t\ttarget milliseconds per repetition (default 20)\n");
+		printf("\t-e\tlargest size for intModExp and intIsPrime (default 2048)\n");
+		printf("\t-p\tlargest size for intMakePrime (default 512)\n");
+		printf("\t-o\twrite the results as JSON to this file\n");
+		printf("\t-c\tcompare against a baseline written by -o\n");
+		printf("\t-x\tpercentage slowdown reported as a regression (default 10)\n");
+		return 1;
+	}
+	FILE* baseline = 0;
+	if (baselinePath) {
+		baseline = fopen(baselinePath, "r");
+		if (!baseline) {
+			printf("Couldn't open the baseline file.\n");
+			return 2;
+		}
+	}
+	uint64_t operationCount = sizeof operations / sizeof * operations;
+	uint64_t resultCapacity = 16;
+	uint64_t resultCount = 0;
+	uint64_t regressions = 0;
+	struct benchResult* results = malloc(resultCapacity * sizeof * results);
+	openCounters();
+	if (!countersOpen) {
+		printf("Hardware counters are unavailable; reporting time only.\n");
+	}
+	printf("%-14s %6s %10s %14s %9s %12s", "op", "bits", "iters", "median ns", "stddev%", "cycles/limb");
+	if (countersOpen) {
+		printf(" %6s %9s %9s %9s %9s", "IPC", "L1/limb", "LLC/limb", "br/limb", "dTLB/limb");
+	}
+	printf(baseline ? " %9s\n" : "\n", "vs base");
+	const char* size = sizes;
+	while (*size) {
+		uint64_t bits = strtoull(size, 0, 10);
+		size += strcspn(size, ",");
+		size += *size == ',';
+		if (bits < 64) {
+			continue;
+		}
+		struct benchState state;
+		setUp(&state, bits);
+		uint64_t k;
+		for (k = 0; k < operationCount; k++) {
+			const struct benchOp* op = &operations[k];
+			if (
+			    (filter && !strstr(op->name, filter)) ||
+			    (op->limit == LIMIT_EXPONENTIATION && bits > exponentiationLimit) ||
+			    (op->limit == LIMIT_PRIME_SEARCH && bits > primeSearchLimit)
+			) {
+				continue;
+			}
+			if (resultCount == resultCapacity) {
+				resultCapacity *= 2;
+				results = realloc(results, resultCapacity * sizeof * results);
+			}
+			struct benchResult* result = &results[resultCount++];
+			measure(op, &state, result);
+			result->baselineNs = baseline ? findBaseline(baseline, op->name, bits) : 0;
+			printf(
+			    "%-14s %6" PRIu64 " %10" PRIu64 " %14.1f %9.2f %12.2f",
+			    result->name, bits, result->iterations, result->medianNs,
+			    100 * result->stddevNs / result->meanNs, result->cyclesPerLimb
+			);
+			if (countersOpen) {
+				double metrics[5];
+				derivedMetrics(result, metrics);
+				uint32_t m;
+				for (m = 0; m < 5; m++) {
+					if (metrics[m] < 0) {
+						printf(m ? " %9s" : " %6s", "-");
+					} else {
+						printf(m ? " %9.3f" : " %6.2f", metrics[m]);
+					}
+				}
+			}
+			if (result->baselineNs > 0) {
+				double ratio = result->medianNs / result->baselineNs;
+				uint32_t regressed = ratio > 1 + tolerance;
+				regressions += regressed;
+				printf(" %8.3fx%s", ratio, regressed ? "  REGRESSION" : "");
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+		tearDown(&state);
+	}
+	if (outputPath) {
+		FILE* out = fopen(outputPath, "w");
+		if (!out) {
+			printf("Couldn't open the output file.\n");
+			return 2;
+		}
+		writeJson(out, results, resultCount);
+		fclose(out);
+	}
+	if (baseline) {
+		fclose(baseline);
+		printf("%" PRIu64 " regression%s beyond %.0f%%.\n", regressions, regressions == 1 ? "" : "s", 100 * tolerance);
+	}
+	free(results);
+	// A non-zero status lets scripts fail on regressions.
+	return regressions ? 3 : 0;
+}
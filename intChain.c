@@ -1,28 +1,45 @@
 #define _GNU_SOURCE
 
 #include <stdlib.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <linux/random.h>
+#include <string.h>
+#if defined(__SSSE3__) && defined(__x86_64__)
+#include <tmmintrin.h>
+#endif
 
 #include "intChain.h"
+#include "trace.h"
 
 // intChain.c
 // Emory Hufbauer, 2016
 
+// Structure for nodes of intChains:
+struct intNode {
+	struct intNode* next;
+	uint64_t data;
+};
+
+// Number of nodes stored inline in every head:
+//  Chains of up to this many limbs need no allocation beyond the head, and none at all when the head is on the stack.
+#define INLINE_NODES 2
+
 // Structure for heads of intChains:
+//  Inline nodes are linked into the chain like any other, and returned to their head rather than the pool when freed.
 struct intChain {
 	struct intNode* next;
 	struct intNode* last;
 	uint64_t size;
+	uint64_t inlineFree;	// bit k is set while inlineNodes[k] is unused
+	uint64_t* references;	// holders of the nodes, if they are shared; 0 if they are this head's alone
+	struct intNode inlineNodes[INLINE_NODES];
 };
 
-// Structure for nodes of intChains:
-struct intNode {
-	struct intNode* next;
-	uint64_t data;
-};
+// intChainStorage must be able to hold a head:
+typedef char intChainStorageFits[sizeof(struct intChain) <= sizeof(struct intChainStorage) ? 1 : -1];
 
 // Size of ints used in the intNodes:
 #define INT_SIZE 64
@@ -35,27 +52,128 @@ static struct intNode rootZero = {&rootZero, 0};
 
 // intChain with value one for convenience functions:
 static struct intNode nodeOne = {&rootZero, 1};
-static struct intChain chainOne = {&nodeOne, &nodeOne, 1};
+//  It is shareable, and holds its own reference for ever, so shares of it are never copied or freed.
+static uint64_t chainOneReferences = 1;
+static struct intChain chainOne = {&nodeOne, &nodeOne, 1, 0, &chainOneReferences, {{0, 0}}};
 
 // Create a pool to store used intNodes in for recycling:
 //  Avoids excessive calls to malloc and free, and their overhead.
+//  Each thread gets its own pool, so threads never contend over it.
 #define POOL_SIZE 256
-static struct intNode* nodePool[POOL_SIZE];
-static int32_t lastInPool = -1;
+static __thread struct intNode* nodePool[POOL_SIZE];
+static __thread int32_t lastInPool = -1;
+
+#ifdef INTCHAIN_STATS
+// Each thread counts into its own block, so counting never contends:
+//  Blocks are pushed onto a global list the first time a thread counts anything, and stay there for intReadStats
+//  after the thread has gone. Counts are only ever written by their own thread, with relaxed atomics so that
+//  readers on other threads see whole values.
+struct statsBlock {
+	struct intStats stats;
+	struct statsBlock* next;
+};
+static struct statsBlock* statsBlocks;
+static __thread struct statsBlock* localStats;
+
+static struct statsBlock* statsRegister(
+    void
+) {
+	localStats = calloc(1, sizeof * localStats);
+	if (!localStats) {
+		exit(1);
+	}
+	localStats->next = __atomic_load_n(&statsBlocks, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&statsBlocks, &localStats->next, localStats, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return localStats;
+} // O(1)
+
+#define STAT(field, n) do { \
+	struct statsBlock* block = localStats ? localStats : statsRegister(); \
+	__atomic_store_n(&block->stats.field, block->stats.field + (n), __ATOMIC_RELAXED); \
+} while (0)
+#else
+#define STAT(field, n) ((void) 0)
+#endif
+
+// Sum the counters of every thread that has used intChain so far:
+void intReadStats(
+    struct intStats* stats	// receives the totals
+) {
+	memset(stats, 0, sizeof * stats);
+#ifdef INTCHAIN_STATS
+	stats->enabled = 1;
+	struct statsBlock* block = __atomic_load_n(&statsBlocks, __ATOMIC_ACQUIRE);
+	for (; block; block = block->next) {
+		uint32_t k;
+		for (k = 0; k < INT_STATS_OPS; k++) {
+			stats->calls[k] += __atomic_load_n(&block->stats.calls[k], __ATOMIC_RELAXED);
+			stats->limbs[k] += __atomic_load_n(&block->stats.limbs[k], __ATOMIC_RELAXED);
+		}
+		stats->modIterations += __atomic_load_n(&block->stats.modIterations, __ATOMIC_RELAXED);
+		stats->poolHits += __atomic_load_n(&block->stats.poolHits, __ATOMIC_RELAXED);
+		stats->poolMisses += __atomic_load_n(&block->stats.poolMisses, __ATOMIC_RELAXED);
+		stats->inlineNodes += __atomic_load_n(&block->stats.inlineNodes, __ATOMIC_RELAXED);
+		stats->shares += __atomic_load_n(&block->stats.shares, __ATOMIC_RELAXED);
+		stats->unshares += __atomic_load_n(&block->stats.unshares, __ATOMIC_RELAXED);
+		stats->mallocs += __atomic_load_n(&block->stats.mallocs, __ATOMIC_RELAXED);
+		stats->frees += __atomic_load_n(&block->stats.frees, __ATOMIC_RELAXED);
+		stats->getrandomCalls += __atomic_load_n(&block->stats.getrandomCalls, __ATOMIC_RELAXED);
+	}
+#endif
+} // O(threads)
+
+// Write the counters in readable form:
+void intWriteStats(
+    FILE* out	// stream to write to
+) {
+	static const char* names[INT_STATS_OPS] = {
+		"intAdd", "intSub", "intScale", "intMult", "intMod", "intDiv",
+		"intModExp", "intModExpTable", "intIsPrime", "intMakePrime"
+	};
+	struct intStats stats;
+	intReadStats(&stats);
+	if (!stats.enabled) {
+		fprintf(out, "intChain was built without INTCHAIN_STATS; no counters were gathered.\n");
+		return;
+	}
+	fprintf(out, "%-16s %14s %16s\n", "primitive", "calls", "limbs");
+	uint32_t k;
+	for (k = 0; k < INT_STATS_OPS; k++) {
+		fprintf(out, "%-16s %14" PRIu64 " %16" PRIu64 "\n", names[k], stats.calls[k], stats.limbs[k]);
+	}
+	fprintf(out, "%-16s %14" PRIu64 "\n", "modIterations", stats.modIterations);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "poolHits", stats.poolHits);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "poolMisses", stats.poolMisses);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "inlineNodes", stats.inlineNodes);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "shares", stats.shares);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "unshares", stats.unshares);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "mallocs", stats.mallocs);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "frees", stats.frees);
+	fprintf(out, "%-16s %14" PRIu64 "\n", "getrandomCalls", stats.getrandomCalls);
+} // O(threads)
 
-// Free all the memory left in the pool:
+// Free all the memory left in the calling thread's pool:
 // Because of ((destructor)), this function gets run when the rest of the program finishes.
-static void __attribute__((destructor)) clearPool(void) {
+void __attribute__((destructor)) intClearPool(void) {
+	STAT(frees, lastInPool + 1);
 	lastInPool++;
 	while (lastInPool--) {
 		free(nodePool[lastInPool]);
 	}
 } // O(1)
 
+// Dump the counters at exit if the environment asks for them:
+//  Destructors with a priority run after those without, so the main thread's pool has been freed and counted by now.
+static void __attribute__((destructor(101))) statsAtExit(void) {
+	if (getenv("INTCHAIN_STATS")) {
+		intWriteStats(stderr);
+	}
+} // O(threads)
+
 #ifndef NDEBUG
 // Verify that an inChain is properly structured:
 static uint32_t intCheck(
-    struct intChain* X
+    const struct intChain* X
 ) {
 	if (!X) {
 		return 7;
@@ -94,21 +212,27 @@ static uint32_t intCheck(
 } // O(|X|)
 #endif
 
-// Free a headless chain of nodes and return the number of nodes freed:
+// Free a headless chain of nodes belonging to X and return the number of nodes freed:
 static uint64_t nodeFree(
+    struct intChain* X,			// intChain the nodes belong to
     struct intNode* currentNode	// First node to be freed
 ) {
 	assert(currentNode);
 	uint64_t numberFreed = 0;
 	while (currentNode != &rootZero) {
 		struct intNode* nextNode = currentNode->next;
-		if (lastInPool + 1 < POOL_SIZE) {
+		uintptr_t inlineOffset = (uintptr_t) currentNode - (uintptr_t) X->inlineNodes;
+		if (inlineOffset < sizeof X->inlineNodes) {
+			// Inline nodes go back to their head:
+			X->inlineFree |= (uint64_t) 1 << (inlineOffset / sizeof * currentNode);
+		} else if (lastInPool + 1 < POOL_SIZE) {
 			// If there is space in the recycling pool, put the node there for reuse:
 			nodePool[lastInPool + 1] = currentNode;
 			lastInPool++;
 		} else {
 			// If there is no more space in the pool, free the node:
 			free(currentNode);
+			STAT(frees, 1);
 		}
 		currentNode = nextNode;
 		numberFreed++;
@@ -121,27 +245,51 @@ void intFree(
     struct intChain* X  // intChain to be freed
 ) {
 	assert(!intCheck(X));
-	nodeFree(X->next);
+	intRelease(X);
 	free(X);
+	STAT(frees, 1);
 } // O(|X|)
 
-// intChain node constructor:
+// Free the nodes of an intChain made by intInit, leaving its storage to the caller:
+void intRelease(
+    struct intChain* X	// intChain to be released
+) {
+	assert(!intCheck(X));
+	if (!X->references) {
+		nodeFree(X, X->next);
+	} else if (__atomic_sub_fetch(X->references, 1, __ATOMIC_ACQ_REL) == 0) {
+		// The last holder of shared nodes frees them:
+		nodeFree(X, X->next);
+		free(X->references);
+		STAT(frees, 1);
+	}
+} // O(|X|)
+
+// intChain node constructor, for a node to be linked into X:
 static struct intNode* nodeMake(
-    void
+    struct intChain* X	// intChain the node will belong to
 ) {
 	// Using "volatile" prevents the compiler from doing crazy things when optimizing.
 	struct intNode* volatile newNode;
-	if (lastInPool == -1) {
+	if (X->inlineFree) {
+		// Use the head's own storage while it lasts:
+		newNode = &X->inlineNodes[__builtin_ctzll(X->inlineFree)];
+		X->inlineFree &= X->inlineFree - 1;
+		STAT(inlineNodes, 1);
+	} else if (lastInPool == -1) {
 		// If the recycling pool is empty, allocate a new node:
 		newNode = malloc(sizeof * newNode);
 		if (!newNode) {
 			// If the pool is empty and malloc fails, give up on life:
 			exit(1);
 		}
+		STAT(poolMisses, 1);
+		STAT(mallocs, 1);
 	} else {
 		// Otherwise, use the last node in the recycling pool:
 		newNode = nodePool[lastInPool];
 		lastInPool--;
+		STAT(poolHits, 1);
 	}
 	newNode->data = 0;
 	newNode->next = &rootZero;
@@ -158,25 +306,123 @@ struct intChain* intMake(
 	struct intChain* volatile newChain = malloc(sizeof * newChain);
 	if (!newChain) {
 		// If malloc fails, try clearing the pool to squeeze out a little bit more memory:
-		clearPool();
+		intClearPool();
 		newChain = malloc(sizeof * newChain);
 		if (!newChain) {
 			// If it still didn't work, just die:
 			exit(1);
 		}
 	}
+	STAT(mallocs, 1);
+	return intInit((struct intChainStorage*) newChain);
+} // O(1)
+
+// intChain head constructor, in caller-provided storage:
+struct intChain* intInit(
+    struct intChainStorage* storage	// storage to hold the intChain
+) {
+	assert(storage);
+	struct intChain* newChain = (struct intChain*) storage;
 	newChain->size = 0;
 	newChain->next = &rootZero;
 	newChain->last = (struct intNode*) newChain;
 	// "Last" always points to the last node before the first rootZero in the chain.
 	//  When the chain has length zero, last is the head of the chain itself.
 	//  This way, even if the chain has length zero, it is easy to append a node to the end of it.
+	newChain->inlineFree = ((uint64_t) 1 << INLINE_NODES) - 1;
+	newChain->references = 0;
 	return newChain;
 } // O(1)
 
+// Let the nodes of X be shared by intShare, rather than copied:
+void intShareable(
+    struct intChain* X	// intChain to be made shareable
+) {
+	assert(!intCheck(X));
+	if (X->references || X->next == &rootZero) {
+		return;
+	}
+	// Shared nodes can outlive X, so move any out of its inline storage, taking their replacements from the pool:
+	X->inlineFree = 0;
+	struct intNode* previousNode = (struct intNode*) X;
+	while (previousNode->next != &rootZero) {
+		struct intNode* currentNode = previousNode->next;
+		if ((uintptr_t) currentNode - (uintptr_t) X->inlineNodes < sizeof X->inlineNodes) {
+			struct intNode* newNode = nodeMake(X);
+			newNode->data = currentNode->data;
+			newNode->next = currentNode->next;
+			previousNode->next = newNode;
+			if (X->last == currentNode) {
+				X->last = newNode;
+			}
+		}
+		previousNode = previousNode->next;
+	}
+	X->inlineFree = ((uint64_t) 1 << INLINE_NODES) - 1;
+	X->references = malloc(sizeof * X->references);
+	if (!X->references) {
+		exit(1);
+	}
+	STAT(mallocs, 1);
+	*X->references = 1;
+} // O(|X|)
+
+// Return a new intChain equal to X, sharing X's nodes if X is shareable and copying them otherwise:
+struct intChain* intShare(
+    const struct intChain* X	// intChain to be shared
+) {
+	assert(!intCheck(X));
+	if (!X->references) {
+		return intCopy(X);
+	}
+	__atomic_add_fetch(X->references, 1, __ATOMIC_RELAXED);
+	STAT(shares, 1);
+	struct intChain* Y = intMake();
+	Y->next = X->next;
+	Y->last = X->last;
+	Y->size = X->size;
+	Y->references = X->references;
+	return Y;
+} // O(1)
+
+// Give X nodes of its own before it is modified, copying them if other intChains still share them:
+static void intUnshare(
+    struct intChain* X	// intChain about to be modified
+) {
+	uint64_t* references = X->references;
+	if (!references) {
+		return;
+	}
+	X->references = 0;
+	if (__atomic_load_n(references, __ATOMIC_ACQUIRE) == 1) {
+		// X is the last holder, so the nodes are already its own:
+		free(references);
+		STAT(frees, 1);
+		return;
+	}
+	STAT(unshares, 1);
+	struct intNode* sharedNode = X->next;
+	struct intNode* firstShared = sharedNode;
+	X->next = &rootZero;
+	X->last = (struct intNode*) X;
+	while (sharedNode != &rootZero) {
+		struct intNode* newNode = nodeMake(X);
+		newNode->data = sharedNode->data;
+		X->last->next = newNode;
+		X->last = newNode;
+		sharedNode = sharedNode->next;
+	}
+	if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0) {
+		// Every other holder let go while the nodes were being copied:
+		nodeFree(X, firstShared);
+		free(references);
+		STAT(frees, 1);
+	}
+} // O(|X|)
+
 // Given a pointer to an intChain X, create a new intChain which is a copy of X and return a pointer to it:
 struct intChain* intCopy(
-    struct intChain* X	// intChain to be copied
+    const struct intChain* X	// intChain to be copied
 ) {
 	assert(!intCheck(X));
 	// Create the head of the new intChain:
@@ -184,7 +430,7 @@ struct intChain* intCopy(
 	struct intNode* currentNodeX = X->next;
 	while (currentNodeX != &rootZero) {
 		// Make a new node for Y:
-		struct intNode* newNodeY = nodeMake();
+		struct intNode* newNodeY = nodeMake(Y);
 		newNodeY->data = currentNodeX->data;
 		// Append it to the end of Y:
 		Y->last->next = newNodeY;
@@ -199,7 +445,7 @@ struct intChain* intCopy(
 //  This allows intChains to be locally reused without the overhead of using the recycling pool.
 static struct intChain* intOverwrite(
     struct intChain* X,	// intChain to be overwritten
-    struct intChain* Y	// intChain to be copied
+    const struct intChain* Y	// intChain to be copied
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
@@ -209,7 +455,7 @@ static struct intChain* intOverwrite(
 	while (currentNodeY != &rootZero) {
 		if (currentNodeX == &rootZero) {
 			// If there are no more nodes in X, append a new one:
-			currentNodeX = nodeMake();
+			currentNodeX = nodeMake(X);
 			previousNodeX->next = currentNodeX;
 		}
 		// Overwrite the data:
@@ -219,7 +465,7 @@ static struct intChain* intOverwrite(
 		previousNodeX = previousNodeX->next;
 	}
 	// Free extra nodes in X:
-	nodeFree(previousNodeX->next);
+	nodeFree(X, previousNodeX->next);
 	// Update X's head:
 	previousNodeX->next = &rootZero;
 	X->size = Y->size;
@@ -234,7 +480,7 @@ static void intRShiftLarge(
 ) {
 	assert(!intCheck(X));
 	if (n >= X->size) {
-		nodeFree(X->next);
+		nodeFree(X, X->next);
 		X->next = &rootZero;
 		X->last = (struct intNode*) X;
 		X->size = 0;
@@ -249,7 +495,7 @@ static void intRShiftLarge(
 	// Break the chain between the nth and n+1st nodes:
 	previousNode->next = &rootZero;
 	// Free the first part of the chain (and update the size):
-	X->size -= nodeFree(X->next);
+	X->size -= nodeFree(X, X->next);
 	// Reattach the latter part of the chain:
 	X->next = currentNode;
 } // O(n)
@@ -281,7 +527,7 @@ static void intRShiftSmall(
 	X->last->data >>= n;
 	if (X->last->data == 0) {
 		// If that last node is now zero, free it:
-		nodeFree(X->last);
+		nodeFree(X, X->last);
 		X->last = currentNode;
 		// Using the pointer to the second-to-last node here.
 		currentNode->next = &rootZero;
@@ -299,6 +545,7 @@ void intRShift(
 	if (X->next == &rootZero) {
 		return;
 	}
+	intUnshare(X);
 	if (n / INT_SIZE != 0) {
 		// Shift by as many whole nodes as possible:
 		intRShiftLarge(X, n / INT_SIZE);
@@ -326,7 +573,7 @@ static void intLShiftLarge(
 	//  The end of the new chain will point to the first node of X.
 	while (n--) {
 		// Make a new node:
-		struct intNode* newNode = nodeMake();
+		struct intNode* newNode = nodeMake(X);
 		// Point it to the previous node:
 		newNode->next = currentNode;
 		currentNode = newNode;
@@ -357,7 +604,7 @@ static void intLShiftSmall(
 	}
 	if (overflow) {
 		// If necessary, append a new node to the end of the chain:
-		currentNode->next = nodeMake();
+		currentNode->next = nodeMake(X);
 		currentNode->next->data = overflow;
 		X->size++;
 		X->last = currentNode->next;
@@ -371,6 +618,7 @@ void intLShift(
     uint64_t n			// number of bits to shift it by
 ) {
 	assert(!intCheck(X));
+	intUnshare(X);
 	if (n / INT_SIZE != 0) {
 		intLShiftLarge(X, n / INT_SIZE);
 	}
@@ -398,8 +646,8 @@ static uint32_t highestBitSignificance(
 
 // Given two intChains, X and Y, return a heuristic approximation to log(X/Y):
 int64_t __attribute__((pure)) intCompare(
-    struct intChain* X, // intChain to be compared
-    struct intChain* Y  // intChain to be compared to
+    const struct intChain* X, // intChain to be compared
+    const struct intChain* Y  // intChain to be compared to
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
@@ -423,7 +671,7 @@ int64_t __attribute__((pure)) intCompare(
 
 // Given an intChain, X, return a heuristic approximation to log(X):
 int64_t __attribute__((pure)) intMagnitude(
-    struct intChain* X  // intChain whose size to estimate
+    const struct intChain* X  // intChain whose size to estimate
 ) {
 	return intCompare(X, &chainOne);
 } // O(1)
@@ -433,8 +681,8 @@ int64_t __attribute__((pure)) intMagnitude(
 //          2 if the second argument is clearly greater,
 //      and 0 if they are very similar (but not necessarily equal).
 static uint32_t __attribute__((pure)) intHeadCompare(
-    struct intChain* X,	// intChain to be compared
-    struct intChain* Y	// intChain to be compared to
+    const struct intChain* X,	// intChain to be compared
+    const struct intChain* Y	// intChain to be compared to
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
@@ -458,8 +706,8 @@ static uint32_t __attribute__((pure)) intHeadCompare(
 // Given two intChains, X and Y, return 0 if they are equal, 1 if X is greater, and 2 else:
 //  Doesn't give false positives, but slow if the arguments are equal or nearly equal.
 uint32_t __attribute__((pure)) intFineCompare(
-    struct intChain* X,	// intChain to be compared
-    struct intChain* Y	// intChain to be compared to
+    const struct intChain* X,	// intChain to be compared
+    const struct intChain* Y	// intChain to be compared to
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
@@ -487,10 +735,13 @@ uint32_t __attribute__((pure)) intFineCompare(
 // Given two intChains, X and Y, perform X += Y:
 void intAdd(
     struct intChain* X,	// intChain to be added to
-    struct intChain* Y	// intChain to be added
+    const struct intChain* Y	// intChain to be added
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
+	STAT(calls[INT_STATS_ADD], 1);
+	STAT(limbs[INT_STATS_ADD], X->size + Y->size);
+	intUnshare(X);
 	struct intNode* currentNodeX = X->next;
 	struct intNode* currentNodeY = Y->next;
 	uint32_t carryBit = 0;
@@ -498,7 +749,7 @@ void intAdd(
 	while (currentNodeY != &rootZero || carryBit) {
 		if (currentNodeX == &rootZero) {
 			// If there are no more nodes in X, append a new one:
-			currentNodeX = nodeMake();
+			currentNodeX = nodeMake(X);
 			X->last->next = currentNodeX;
 			X->last = currentNodeX;
 			X->size++;
@@ -518,10 +769,13 @@ void intAdd(
 // Given two intChains, X and Y, perform X -= Y:
 void intSub(
     struct intChain* X,	// intChain to be subtracted from
-    struct intChain* Y	// intChain to be subtracted
+    const struct intChain* Y	// intChain to be subtracted
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
+	STAT(calls[INT_STATS_SUB], 1);
+	STAT(limbs[INT_STATS_SUB], X->size + Y->size);
+	intUnshare(X);
 	struct intNode* currentNodeX = X->next;
 	struct intNode* currentNodeY = Y->next;
 	struct intNode* lastNonZeroNodeX = (struct intNode*) X;
@@ -529,10 +783,11 @@ void intSub(
 	// Proceed until there is nothing left to subtract:
 	while (currentNodeY != &rootZero || carryBit) {
 		// Subtract and check for underflow:
-		uint32_t newCarryBit = (currentNodeX->data < currentNodeY->data);
-		currentNodeX->data -= currentNodeY->data + carryBit;
-		carryBit = newCarryBit + (currentNodeX->data == UINT_MAX);
-		// Again, addition for speed.
+		//  Either step can borrow, but never both, so the borrow stays a single bit.
+		uint64_t difference = currentNodeX->data - currentNodeY->data;
+		uint32_t newCarryBit = (currentNodeX->data < currentNodeY->data) | (difference < carryBit);
+		currentNodeX->data = difference - carryBit;
+		carryBit = newCarryBit;
 		if (currentNodeX->data) {
 			// Keep track of the last non-zero node:
 			lastNonZeroNodeX = currentNodeX;
@@ -542,7 +797,7 @@ void intSub(
 	}
 	if (currentNodeX == &rootZero) {
 		// Trim the end of X:
-		X->size -= nodeFree(lastNonZeroNodeX->next);
+		X->size -= nodeFree(X, lastNonZeroNodeX->next);
 		lastNonZeroNodeX->next = &rootZero;
 		X->last = lastNonZeroNodeX;
 	}
@@ -564,50 +819,59 @@ void intDecrement(
 
 // Check if the given intChain is even:
 uint32_t intIsEven(
-    struct intChain* X  // intChain to check the parity of
+    const struct intChain* X  // intChain to check the parity of
 ) {
-	return !(X->last->data & 0x0000000000000001);
+	return !(X->next->data & 0x0000000000000001);
 } // O(1)
 
 // Given two intChains X and Y, reduce X mod Y (much faster than full division):
 void intMod(
     struct intChain* X,	// intChain to reduce
-    struct intChain* Y	// intChain to reduce by
+    const struct intChain* Y	// intChain to reduce by
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
 	// Yell about division by zero:
 	assert(Y->next != &rootZero);
+	STAT(calls[INT_STATS_MOD], 1);
+	STAT(limbs[INT_STATS_MOD], X->size + Y->size);
 	// Use intCompare to get an initial power-of-two scaling factor for Y:
 	int64_t exponent = intCompare(X, Y);
 	if (exponent < 0) {
 		// If the exponent is less than zero, Y>X, so return.
 		return;
 	}
+	intUnshare(X);
 	// Safety factor:
 	exponent += 2;
-	// Shift Y by exponent bits:
-	intLShift(Y, (uint64_t) exponent);
+	STAT(modIterations, exponent);
+	// Shift a copy of Y by exponent bits, so Y itself is never touched and can be shared between threads:
+	struct intChainStorage shiftedStorage;
+	struct intChain* Shifted = intInit(&shiftedStorage);
+	intAdd(Shifted, Y);
+	intLShift(Shifted, (uint64_t) exponent);
 	// For all powers of two less than 2^exponent:
 	while (exponent--) {
-		intRShiftSmall(Y, 1);
-		if (intFineCompare(X, Y) < 2) {
+		intRShiftSmall(Shifted, 1);
+		if (intFineCompare(X, Shifted) < 2) {
 			// If X >= Y, subtract Y from X:
-			intSub(X, Y);
+			intSub(X, Shifted);
 		}
 	}
-	// Note that Y is now restored to its original value.
+	intRelease(Shifted);
 } // O(|X|/|Y|)
 
 // Given two intChains X and Y, reduce X mod Y and return a new intChain containing their quotient:
 struct intChain* intDiv(
     struct intChain* X,	// intChain to reduce
-    struct intChain* Y	// intChain to divide by
+    const struct intChain* Y	// intChain to divide by
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
 	// Yell about division by zero:
 	assert(Y->next != &rootZero);
+	STAT(calls[INT_STATS_DIV], 1);
+	STAT(limbs[INT_STATS_DIV], X->size + Y->size);
 	if (X->next == &rootZero) {
 		// If X is zero, return zero:
 		return intMake();
@@ -618,23 +882,31 @@ struct intChain* intDiv(
 		// If the exponent is less than zero, Y>X, so return.
 		return intMake();
 	}
+	intUnshare(X);
 	struct intChain* quotient = intMake();
-	struct intChain* currentPower = intCopy(&chainOne);
+	struct intChainStorage currentPowerStorage;
+	struct intChain* currentPower = intInit(&currentPowerStorage);
+	intIncrement(currentPower);
 	// Safety factor
 	exponent += 2;
+	STAT(modIterations, exponent);
+	struct intChainStorage shiftedStorage;
+	struct intChain* Shifted = intInit(&shiftedStorage);
+	intAdd(Shifted, Y);
 	intLShift(currentPower, (uint64_t) exponent);
-	intLShift(Y, (uint64_t) exponent);
+	intLShift(Shifted, (uint64_t) exponent);
 	while (exponent--) {
-		intRShift(Y, 1);
+		intRShift(Shifted, 1);
 		intRShift(currentPower, 1);
-		if (intFineCompare(X, Y) < 2) {
+		if (intFineCompare(X, Shifted) < 2) {
 			// If X >= Y, subtract Y from X:
-			intSub(X, Y);
+			intSub(X, Shifted);
 			// Increment the quotient:
 			intAdd(quotient, currentPower);
 		}
 	}
-	intFree(currentPower);
+	intRelease(currentPower);
+	intRelease(Shifted);
 	return quotient;
 } // O(|X|/|Y|)
 
@@ -644,14 +916,18 @@ void intScale(
     uint64_t scalar		// integer to scale by
 ) {
 	assert(!intCheck(X));
+	STAT(calls[INT_STATS_SCALE], 1);
+	STAT(limbs[INT_STATS_SCALE], X->size);
+	if (X->next == &rootZero || scalar == 1) {
+		return;
+	}
+	intUnshare(X);
 	if (scalar == 0) {
-		nodeFree(X->next);
+		nodeFree(X, X->next);
 		X->next = &rootZero;
 		X->last = (struct intNode*) X;
 		X->size = 0;
 		return;
-	} else if (X->next == &rootZero || scalar == 1) {
-		return;
 	}
 	struct intNode* currentNode = X->next;
 	// Split the scalar into a low and high part, each of half size:
@@ -662,7 +938,7 @@ void intScale(
 	while (currentNode != &rootZero || carry) {
 		if (currentNode == &rootZero) {
 			// If there are no more nodes in X, append a new one:
-			currentNode = nodeMake();
+			currentNode = nodeMake(X);
 			X->last->next = currentNode;
 			X->last = currentNode;
 			X->size++;
@@ -696,17 +972,20 @@ void intScale(
 
 // Return a new intChain containing the product of X and Y:
 struct intChain* intMult(
-    struct intChain* X, // First intChain to be multiplied
-    struct intChain* Y	// Second intChain to be multiplied
+    const struct intChain* X, // First intChain to be multiplied
+    const struct intChain* Y	// Second intChain to be multiplied
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
+	STAT(calls[INT_STATS_MULT], 1);
+	STAT(limbs[INT_STATS_MULT], X->size + Y->size);
 	if (Y->next == &rootZero || X->next == &rootZero) {
 		// Multiplication by zero:
 		return intMake();
 	}
 	struct intChain* Product = intMake();
-	struct intChain* Component = intMake();
+	struct intChainStorage componentStorage;
+	struct intChain* Component = intInit(&componentStorage);
 	// For all nodes in X:
 	uint64_t significance = 0;
 	struct intNode* currentNodeX = X->next;
@@ -721,21 +1000,903 @@ struct intChain* intMult(
 		intAdd(Product, Component);
 		currentNodeX = currentNodeX->next;
 	}
-	intFree(Component);
+	intRelease(Component);
 	return Product;
 } // O(|X|*|Y|)
 
+// Fixed-width Montgomery arithmetic for the standard key sizes:
+//  Operands are arrays of n little-endian limbs on the stack rather than chains. The routines below are written
+//  once over n and forced inline, and FIXED_WIDTH instantiates them for each standard width, so every loop bound
+//  is a compile-time constant the compiler can unroll. In Montgomery form a is held as aR mod M, R = 2^(64n),
+//  which turns each reduction into n rows of multiply-adds instead of a shift-and-subtract per bit.
+#define FIXED_INLINE static inline __attribute__((always_inline))
+#define FIXED_UNROLL _Pragma("GCC unroll 16")
+__extension__ typedef unsigned __int128 limbPair;
+
+// Return -M^-1 mod 2^64 for the low limb of an odd modulus M:
+//  Newton's iteration doubles the number of correct bits each step, and M is its own inverse to three bits.
+static uint64_t montgomeryInverse(
+    uint64_t m		// low limb of the modulus
+) {
+	uint64_t inverse = m;
+	uint32_t step = 5;
+	while (step--) {
+		inverse *= 2 - m * inverse;
+	}
+	return -inverse;
+} // O(1)
+
+// Given T < 2M held as n limbs plus a top bit, write T mod M to R:
+FIXED_INLINE void fixedReduceOnce(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* t,	// value to reduce, n limbs
+    uint64_t top,		// bit above the n limbs of t
+    const uint64_t* m,	// modulus, n limbs
+    uint32_t n			// limbs per value
+) {
+	uint64_t difference[n];
+	uint64_t borrow = 0;
+	uint32_t j;
+	FIXED_UNROLL
+	for (j = 0; j < n; j++) {
+		limbPair step = (limbPair) t[j] - m[j] - borrow;
+		difference[j] = (uint64_t) step;
+		borrow = (uint64_t) (step >> INT_SIZE) & 1;
+	}
+	const uint64_t* source = (top || !borrow) ? difference : t;
+	memcpy(r, source, n * sizeof * r);
+} // O(n)
+
+// Given A and B in Montgomery form, write ABR^-1 mod M to R:
+//  Coarsely integrated operand scanning: each row multiplies in one limb of B, then cancels the low limb with a
+//  multiple of M and shifts down. R may alias A or B.
+FIXED_INLINE void fixedMultiply(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* a,	// first factor, n limbs
+    const uint64_t* b,	// second factor, n limbs
+    const uint64_t* m,	// modulus, n limbs
+    uint64_t inverse,	// -M^-1 mod 2^64
+    uint32_t n			// limbs per value
+) {
+	uint64_t t[n + 2];
+	memset(t, 0, sizeof t);
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		limbPair carry = 0;
+		uint32_t j;
+		FIXED_UNROLL
+		for (j = 0; j < n; j++) {
+			carry += (limbPair) a[j] * b[i] + t[j];
+			t[j] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+		carry += t[n];
+		t[n] = (uint64_t) carry;
+		t[n + 1] = (uint64_t) (carry >> INT_SIZE);
+		uint64_t u = t[0] * inverse;
+		carry = ((limbPair) u * m[0] + t[0]) >> INT_SIZE;
+		FIXED_UNROLL
+		for (j = 1; j < n; j++) {
+			carry += (limbPair) u * m[j] + t[j];
+			t[j - 1] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+		carry += t[n];
+		t[n - 1] = (uint64_t) carry;
+		t[n] = t[n + 1] + (uint64_t) (carry >> INT_SIZE);
+	}
+	fixedReduceOnce(r, t, t[n], m, n);
+} // O(n^2)
+
+// Write the double-width square of A to T:
+//  Each cross product is computed once and doubled, which saves nearly half the multiplications of a full product.
+FIXED_INLINE void fixedSquareProduct(
+    uint64_t* t,		// result, 2n limbs
+    const uint64_t* a,	// value to square, n limbs
+    uint32_t n			// limbs per value
+) {
+	memset(t, 0, 2 * n * sizeof * t);
+	uint32_t i;
+	uint32_t j;
+	// Cross products a[i]a[j] for i < j:
+	for (i = 0; i + 1 < n; i++) {
+		limbPair carry = 0;
+		for (j = i + 1; j < n; j++) {
+			carry += (limbPair) a[i] * a[j] + t[i + j];
+			t[i + j] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+		t[i + n] = (uint64_t) carry;
+	}
+	// Double them; they sum to less than half of A^2, so nothing is shifted out:
+	uint64_t high = 0;
+	FIXED_UNROLL
+	for (j = 0; j < 2 * n; j++) {
+		uint64_t next = t[j] >> (INT_SIZE - 1);
+		t[j] = t[j] << 1 | high;
+		high = next;
+	}
+	// Add the squares a[i]^2 on the diagonal:
+	limbPair carry = 0;
+	FIXED_UNROLL
+	for (i = 0; i < n; i++) {
+		carry += (limbPair) a[i] * a[i] + t[2 * i];
+		t[2 * i] = (uint64_t) carry;
+		carry >>= INT_SIZE;
+		carry += t[2 * i + 1];
+		t[2 * i + 1] = (uint64_t) carry;
+		carry >>= INT_SIZE;
+	}
+} // O(n^2)
+
+// Given A in Montgomery form, write A^2 R^-1 mod M to R:
+//  Squares with fixedSquareProduct, then reduces the double-width square row by row. R may alias A.
+FIXED_INLINE void fixedSquare(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* a,	// value to square, n limbs
+    const uint64_t* m,	// modulus, n limbs
+    uint64_t inverse,	// -M^-1 mod 2^64
+    uint32_t n			// limbs per value
+) {
+	uint64_t t[2 * n];
+	fixedSquareProduct(t, a, n);
+	uint32_t i;
+	uint32_t j;
+	limbPair carry;
+	// Cancel one low limb per row, carrying out of the top through extra:
+	uint64_t extra = 0;
+	for (i = 0; i < n; i++) {
+		uint64_t u = t[i] * inverse;
+		carry = 0;
+		FIXED_UNROLL
+		for (j = 0; j < n; j++) {
+			carry += (limbPair) u * m[j] + t[i + j];
+			t[i + j] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+		carry += (limbPair) t[i + n] + extra;
+		t[i + n] = (uint64_t) carry;
+		extra = (uint64_t) (carry >> INT_SIZE);
+	}
+	fixedReduceOnce(r, t + n, extra, m, n);
+} // O(n^2)
+
+// Write the double-width product of A and B to T:
+FIXED_INLINE void fixedProduct(
+    uint64_t* t,		// result, 2n limbs
+    const uint64_t* a,	// first factor, n limbs
+    const uint64_t* b,	// second factor, n limbs
+    uint32_t n			// limbs per value
+) {
+	memset(t, 0, 2 * n * sizeof * t);
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		limbPair carry = 0;
+		uint32_t j;
+		FIXED_UNROLL
+		for (j = 0; j < n; j++) {
+			carry += (limbPair) a[j] * b[i] + t[i + j];
+			t[i + j] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+		t[i + n] = (uint64_t) carry;
+	}
+} // O(n^2)
+
+// Pseudo-Mersenne moduli, M = 2^(64n) - c with c below 2^32:
+//  2^(64n) is c mod M, so the high half of a double-width value folds onto the low half with one multiplication by c
+//  per limb, in place of Montgomery's n rows. Values are then held as themselves, with R = 1.
+#define FOLD_LIMIT ((uint64_t) 1 << 32)
+
+// Given the double-width T, write T mod M to R for M = 2^(64n) - c:
+FIXED_INLINE void fixedFold(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* t,	// value to reduce, 2n limbs
+    uint64_t c,			// 2^(64n) - M
+    uint32_t n			// limbs per value
+) {
+	uint64_t s[n];
+	limbPair carry = 0;
+	uint32_t j;
+	FIXED_UNROLL
+	for (j = 0; j < n; j++) {
+		carry += (limbPair) t[n + j] * c + t[j];
+		s[j] = (uint64_t) carry;
+		carry >>= INT_SIZE;
+	}
+	// The word left over is at most c, so folding it in again fits in a limb pair; a carry out of that fold leaves
+	//  s small, so the third fold can't carry again:
+	uint32_t fold;
+	for (fold = 0; fold < 2; fold++) {
+		carry *= c;
+		FIXED_UNROLL
+		for (j = 0; j < n; j++) {
+			carry += s[j];
+			s[j] = (uint64_t) carry;
+			carry >>= INT_SIZE;
+		}
+	}
+	// Now s < 2^(64n) < 2M, and s >= M exactly when s + c carries out:
+	uint64_t sum[n];
+	carry = c;
+	FIXED_UNROLL
+	for (j = 0; j < n; j++) {
+		carry += s[j];
+		sum[j] = (uint64_t) carry;
+		carry >>= INT_SIZE;
+	}
+	memcpy(r, carry ? sum : s, n * sizeof * r);
+} // O(n)
+
+// Given A and B, write AB mod M to R for M = 2^(64n) - c:
+FIXED_INLINE void fixedFoldMultiply(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* a,	// first factor, n limbs
+    const uint64_t* b,	// second factor, n limbs
+    uint64_t c,			// 2^(64n) - M
+    uint32_t n			// limbs per value
+) {
+	uint64_t t[2 * n];
+	fixedProduct(t, a, b, n);
+	fixedFold(r, t, c, n);
+} // O(n^2)
+
+// Given A, write A^2 mod M to R for M = 2^(64n) - c:
+FIXED_INLINE void fixedFoldSquare(
+    uint64_t* r,		// result, n limbs
+    const uint64_t* a,	// value to square, n limbs
+    uint64_t c,			// 2^(64n) - M
+    uint32_t n			// limbs per value
+) {
+	uint64_t t[2 * n];
+	fixedSquareProduct(t, a, n);
+	fixedFold(r, t, c, n);
+} // O(n^2)
+
+// Return c if Z = 2^(64n) - c for a c below FOLD_LIMIT, or 0 if Z has some other form:
+static uint64_t foldOffset(
+    const struct intChain* Z	// modulus
+) {
+	if (Z->size < 2) {
+		return 0;
+	}
+	const struct intNode* currentNode = Z->next;
+	uint64_t c = -currentNode->data;
+	if (c == 0 || c >= FOLD_LIMIT) {
+		return 0;
+	}
+	for (currentNode = currentNode->next; currentNode != &rootZero; currentNode = currentNode->next) {
+		if (currentNode->data != UINT_MAX) {
+			return 0;
+		}
+	}
+	return c;
+} // O(|Z|)
+
+// Copy an intChain of at most n limbs into an array, padding with zeroes:
+static void fixedFromChain(
+    uint64_t* r,			// result, n limbs
+    const struct intChain* X,		// intChain to copy
+    uint32_t n				// limbs in the array
+) {
+	assert(X->size <= n);
+	struct intNode* currentNode = X->next;
+	while (n--) {
+		// Past the end of X, currentNode sits on rootZero and pads with zeroes:
+		*(r++) = currentNode->data;
+		currentNode = currentNode->next;
+	}
+} // O(n)
+
+// Load n little-endian 64-bit limbs from a byte buffer, which need not be aligned:
+static void fixedFromBytes(
+    uint64_t* r,			// result, n limbs
+    const uint8_t* buffer,	// buffer of at least 8 * n bytes
+    uint32_t n				// limbs
+) {
+	uint32_t k;
+	for (k = 0; k < n; k++) {
+		uint64_t data = 0;
+		uint32_t j = INT_SIZE / 8;
+		while (j--) {
+			data <<= 8;
+			data += buffer[j];
+		}
+		r[k] = data;
+		buffer += INT_SIZE / 8;
+	}
+} // O(n)
+
+// Build a new intChain from an array of n limbs:
+static struct intChain* fixedToChain(
+    const uint64_t* a,		// array to copy
+    uint32_t n				// limbs in the array
+) {
+	struct intChain* X = intMake();
+	while (n && a[n - 1] == 0) {
+		n--;
+	}
+	uint32_t j;
+	for (j = 0; j < n; j++) {
+		struct intNode* newNode = nodeMake(X);
+		newNode->data = a[j];
+		X->last->next = newNode;
+		X->last = newNode;
+	}
+	X->last->next = &rootZero;
+	X->size = n;
+	return X;
+} // O(n)
+
+// Precomputed Montgomery constants for one odd modulus:
+//  Built once, then read-only, so one can serve many threads at once. A pseudo-Mersenne modulus reduces by folding
+//  instead, with R = 1, so conversion and one are both 1 and the routines that use them need not know the difference.
+struct intModulus {
+	struct intChain* Modulus;	// shareable copy of the modulus, for reducing operands
+	uint64_t inverse;			// -M^-1 mod 2^64
+	uint64_t offset;			// c for a modulus of the form 2^(64n) - c, or 0
+	uint32_t limbs;
+	// Multiplication and squaring for this width, specialized for the standard ones:
+	void (*multiply)(uint64_t*, const uint64_t*, const uint64_t*, const struct intModulus*);
+	void (*square)(uint64_t*, const uint64_t*, const struct intModulus*);
+	uint64_t* m;				// the modulus as limbs
+	uint64_t* conversion;		// R^2 mod M, which moves values into Montgomery form
+	uint64_t* one;				// R mod M, one in Montgomery form
+};
+
+// Instantiate the Montgomery routines for one width, so every loop bound is a constant:
+#define FIXED_WIDTH(limbs) \
+	static void montgomeryMultiply##limbs( \
+	    uint64_t* r, \
+	    const uint64_t* a, \
+	    const uint64_t* b, \
+	    const struct intModulus* M \
+	) { \
+		fixedMultiply(r, a, b, M->m, M->inverse, limbs); \
+	} \
+	static void montgomerySquare##limbs( \
+	    uint64_t* r, \
+	    const uint64_t* a, \
+	    const struct intModulus* M \
+	) { \
+		fixedSquare(r, a, M->m, M->inverse, limbs); \
+	} \
+	static void foldMultiply##limbs( \
+	    uint64_t* r, \
+	    const uint64_t* a, \
+	    const uint64_t* b, \
+	    const struct intModulus* M \
+	) { \
+		fixedFoldMultiply(r, a, b, M->offset, limbs); \
+	} \
+	static void foldSquare##limbs( \
+	    uint64_t* r, \
+	    const uint64_t* a, \
+	    const struct intModulus* M \
+	) { \
+		fixedFoldSquare(r, a, M->offset, limbs); \
+	}
+
+// 2048-, 3072- and 4096-bit moduli:
+FIXED_WIDTH(32)
+FIXED_WIDTH(48)
+FIXED_WIDTH(64)
+
+// Any other width, with the loop bounds known only at run time:
+static void montgomeryMultiplyAny(
+    uint64_t* r,
+    const uint64_t* a,
+    const uint64_t* b,
+    const struct intModulus* M
+) {
+	fixedMultiply(r, a, b, M->m, M->inverse, M->limbs);
+} // O(n^2)
+
+static void montgomerySquareAny(
+    uint64_t* r,
+    const uint64_t* a,
+    const struct intModulus* M
+) {
+	fixedSquare(r, a, M->m, M->inverse, M->limbs);
+} // O(n^2)
+
+static void foldMultiplyAny(
+    uint64_t* r,
+    const uint64_t* a,
+    const uint64_t* b,
+    const struct intModulus* M
+) {
+	fixedFoldMultiply(r, a, b, M->offset, M->limbs);
+} // O(n^2)
+
+static void foldSquareAny(
+    uint64_t* r,
+    const uint64_t* a,
+    const struct intModulus* M
+) {
+	fixedFoldSquare(r, a, M->offset, M->limbs);
+} // O(n^2)
+
+// Given an odd modulus Z, precompute its Montgomery constants, or set up folding if Z is pseudo-Mersenne:
+struct intModulus* intModulusMake(
+    const struct intChain* Z	// modulus
+) {
+	assert(!intCheck(Z));
+	if (!(Z->next->data & 0x1)) {
+		return 0;
+	}
+	uint32_t n = Z->size;
+	struct intModulus* M = malloc(sizeof * M + 3 * n * sizeof * M->m);
+	if (!M) {
+		exit(1);
+	}
+	STAT(mallocs, 1);
+	M->Modulus = intCopy(Z);
+	intShareable(M->Modulus);
+	M->limbs = n;
+	M->m = (uint64_t*) (M + 1);
+	M->conversion = M->m + n;
+	M->one = M->m + 2 * n;
+	fixedFromChain(M->m, Z, n);
+	M->inverse = montgomeryInverse(M->m[0]);
+	M->offset = foldOffset(Z);
+	if (M->offset) {
+		switch (n) {
+		case 32:
+			M->multiply = foldMultiply32;
+			M->square = foldSquare32;
+			break;
+		case 48:
+			M->multiply = foldMultiply48;
+			M->square = foldSquare48;
+			break;
+		case 64:
+			M->multiply = foldMultiply64;
+			M->square = foldSquare64;
+			break;
+		default:
+			M->multiply = foldMultiplyAny;
+			M->square = foldSquareAny;
+		}
+		// Values are held as themselves:
+		memset(M->conversion, 0, 2 * n * sizeof * M->m);
+		M->conversion[0] = 1;
+		M->one[0] = 1;
+		return M;
+	}
+	switch (n) {
+	case 32:
+		M->multiply = montgomeryMultiply32;
+		M->square = montgomerySquare32;
+		break;
+	case 48:
+		M->multiply = montgomeryMultiply48;
+		M->square = montgomerySquare48;
+		break;
+	case 64:
+		M->multiply = montgomeryMultiply64;
+		M->square = montgomerySquare64;
+		break;
+	default:
+		M->multiply = montgomeryMultiplyAny;
+		M->square = montgomerySquareAny;
+	}
+	struct intChainStorage conversionStorage;
+	struct intChain* Conversion = intInit(&conversionStorage);
+	intIncrement(Conversion);
+	intLShift(Conversion, 2 * INT_SIZE * n);
+	intMod(Conversion, Z);
+	fixedFromChain(M->conversion, Conversion, n);
+	intRelease(Conversion);
+	// Converting one gives R mod M:
+	memset(M->one, 0, n * sizeof * M->one);
+	M->one[0] = 1;
+	M->multiply(M->one, M->one, M->conversion, M);
+	return M;
+} // O(|Z|^2)
+
+// Free the constants made by intModulusMake:
+void intModulusFree(
+    struct intModulus* M	// constants to be freed
+) {
+	intFree(M->Modulus);
+	free(M);
+	STAT(frees, 1);
+} // O(1)
+
+// Return the bytes held by a set of constants, including their copy of the modulus:
+uint64_t intModulusBytes(
+    const struct intModulus* M	// constants of the modulus
+) {
+	return sizeof * M + 3 * M->limbs * sizeof * M->m + sizeof(struct intChain) + M->limbs * sizeof(struct intNode);
+} // O(1)
+
+// Return the modulus a set of constants was made for:
+const struct intChain* intModulusValue(
+    const struct intModulus* M	// constants of the modulus
+) {
+	return M->Modulus;
+} // O(1)
+
+// Return c if the modulus is pseudo-Mersenne, 2^bits - c, storing bits; or return 0 if it reduces by Montgomery:
+uint64_t intModulusOffset(
+    const struct intModulus* M,	// constants of the modulus
+    uint64_t* bits				// receives the power of two; may be 0
+) {
+	if (bits) {
+		*bits = (uint64_t) INT_SIZE * M->limbs;
+	}
+	return M->offset;
+} // O(1)
+
+// Load X into n limbs, reducing it first if it isn't already below the modulus:
+static void modulusLoad(
+    const struct intModulus* M,	// constants of the modulus
+    uint64_t* r,				// result, n limbs
+    const struct intChain* X	// value to load
+) {
+	if (X->size < M->limbs || (X->size == M->limbs && intFineCompare(X, M->Modulus) == 2)) {
+		fixedFromChain(r, X, M->limbs);
+		return;
+	}
+	struct intChainStorage reducedStorage;
+	struct intChain* Reduced = intInit(&reducedStorage);
+	intAdd(Reduced, X);
+	intMod(Reduced, M->Modulus);
+	fixedFromChain(r, Reduced, M->limbs);
+	intRelease(Reduced);
+} // O(|X|) if X is below the modulus
+
+// Given X and Y, return X * Y mod M:
+//  Two Montgomery multiplications on the stack, the second by R^2 to cancel the R^-1 of the first;
+//  the product never exists as an intChain.
+struct intChain* intModulusMult(
+    const struct intChain* X,	// first factor
+    const struct intChain* Y,	// second factor
+    const struct intModulus* M	// constants of the modulus
+) {
+	assert(!intCheck(X));
+	assert(!intCheck(Y));
+	uint32_t n = M->limbs;
+	uint64_t a[n];
+	uint64_t b[n];
+	modulusLoad(M, a, X);
+	modulusLoad(M, b, Y);
+	M->multiply(a, a, b, M);
+	M->multiply(a, a, M->conversion, M);
+	return fixedToChain(a, n);
+} // O(n^2)
+
+// Multiply result by power^Y, both in Montgomery form:
+//  Scans Y from the low bit like intModExp, stopping at its highest set bit; power is left clobbered.
+static void modulusPower(
+    const struct intModulus* M,	// constants of the modulus
+    uint64_t* result,			// accumulator, n limbs
+    uint64_t* power,			// base, n limbs
+    const struct intChain* Y	// exponent
+) {
+	const struct intNode* currentNodeY = Y->next;
+	while (currentNodeY != &rootZero) {
+		uint64_t nodeBits = currentNodeY->data;
+		uint32_t bitCounter = INT_SIZE;
+		uint32_t lastNode = currentNodeY->next == &rootZero;
+		while (bitCounter-- && (nodeBits || !lastNode)) {
+			if (nodeBits & 0x1) {
+				M->multiply(result, result, power, M);
+			}
+			M->square(power, power, M);
+			nodeBits >>= 1;
+		}
+		currentNodeY = currentNodeY->next;
+	}
+} // O(|Y| n^2)
+
+// Return a new intChain holding r, which is in Montgomery form:
+//  Multiplying by one leaves Montgomery form.
+static struct intChain* modulusStore(
+    const struct intModulus* M,	// constants of the modulus
+    const uint64_t* r			// value, n limbs
+) {
+	uint32_t n = M->limbs;
+	uint64_t unit[n];
+	uint64_t value[n];
+	memset(unit, 0, sizeof unit);
+	unit[0] = 1;
+	M->multiply(value, r, unit, M);
+	return fixedToChain(value, n);
+} // O(n^2)
+
+// Given X and Y, return X^Y mod M:
+struct intChain* intModulusExp(
+    const struct intChain* X,	// base
+    const struct intChain* Y,	// exponent
+    const struct intModulus* M	// constants of the modulus
+) {
+	assert(!intCheck(X));
+	assert(!intCheck(Y));
+	uint32_t n = M->limbs;
+	uint64_t power[n];		// X to a power of two, in Montgomery form
+	uint64_t result[n];
+	modulusLoad(M, power, X);
+	M->multiply(power, power, M->conversion, M);
+	memcpy(result, M->one, sizeof result);
+	modulusPower(M, result, power, Y);
+	return modulusStore(M, result);
+} // O(|Y| n^2)
+
+// Return whether the n limbs of r are all zero:
+static uint32_t fixedIsZero(
+    const uint64_t* r,	// value, n limbs
+    uint32_t n			// limbs
+) {
+	uint64_t any = 0;
+	uint32_t k;
+	for (k = 0; k < n; k++) {
+		any |= r[k];
+	}
+	return !any;
+} // O(n)
+
+// Replace r, which is in Montgomery form, with its inverse, by Fermat's little theorem:
+static void modulusInvert(
+    const struct intModulus* M,	// constants of a prime modulus
+    uint64_t* r					// value, n limbs
+) {
+	struct intChainStorage exponentStorage;
+	struct intChain* Exponent = intInit(&exponentStorage);
+	intAdd(Exponent, M->Modulus);
+	intDecrement(Exponent);
+	intDecrement(Exponent);
+	uint64_t power[M->limbs];
+	memcpy(power, r, sizeof power);
+	memcpy(r, M->one, sizeof power);
+	modulusPower(M, r, power, Exponent);
+	intRelease(Exponent);
+} // O(n^3)
+
+// Given X, return X^-1 mod M:
+struct intChain* intModulusInverse(
+    const struct intChain* X,	// value to invert
+    const struct intModulus* M	// constants of a prime modulus
+) {
+	assert(!intCheck(X));
+	uint32_t n = M->limbs;
+	uint64_t value[n];
+	modulusLoad(M, value, X);
+	M->multiply(value, value, M->conversion, M);
+	modulusInvert(M, value);
+	return modulusStore(M, value);
+} // O(n^3)
+
+// Replace each of X[0..count) with its inverse mod M, using one inversion for the whole batch:
+//  Montgomery's trick: invert the product of every value, then peel the values back off it one at a time.
+//  Values with no inverse become zero and are left out of the product, so they can't spoil the others.
+void intModulusBatchInverse(
+    struct intChain** X,		// values to invert, each replaced by a new intChain
+    uint64_t count,				// number of values
+    const struct intModulus* M	// constants of a prime modulus
+) {
+	uint32_t n = M->limbs;
+	// Every value in Montgomery form, and the running products of the values up to each one:
+	uint64_t* values = malloc(2 * count * n * sizeof * values);
+	if (count && !values) {
+		exit(1);
+	}
+	STAT(mallocs, 1);
+	uint64_t* products = values + count * n;
+	uint64_t running[n];
+	memcpy(running, M->one, sizeof running);
+	uint64_t j;
+	for (j = 0; j < count; j++) {
+		assert(!intCheck(X[j]));
+		uint64_t* value = values + j * n;
+		modulusLoad(M, value, X[j]);
+		// Zero values stay zero, which marks them for the second pass:
+		if (!fixedIsZero(value, n)) {
+			M->multiply(value, value, M->conversion, M);
+			M->multiply(running, running, value, M);
+		}
+		memcpy(products + j * n, running, sizeof running);
+	}
+	modulusInvert(M, running);
+	// running is now the inverse of the product of the values before j + 1:
+	uint64_t inverse[n];
+	for (j = count; j-- > 0;) {
+		uint64_t* value = values + j * n;
+		intFree(X[j]);
+		if (fixedIsZero(value, n)) {
+			X[j] = intMake();
+			continue;
+		}
+		if (j) {
+			M->multiply(inverse, running, products + (j - 1) * n, M);
+		} else {
+			memcpy(inverse, running, sizeof inverse);
+		}
+		M->multiply(running, running, value, M);
+		X[j] = modulusStore(M, inverse);
+	}
+	free(values);
+	STAT(frees, 1);
+} // O(count n^2 + n^3)
+
+// Widest window an exponent plan may use; its table of odd powers then has 2^(window - 1) entries on the stack:
+#define INT_EXPONENT_WINDOW 7
+
+// One step of an exponent plan: square squarings times, then multiply by the odd power digit:
+struct intExponentStep {
+	uint32_t squarings;
+	uint32_t digit;
+};
+
+// A sliding-window schedule for one fixed exponent:
+//  The first step starts from its digit's power without squaring; the trailing squarings follow the last step.
+struct intExponentPlan {
+	uint32_t window;			// bits per window; the table holds the odd powers below 2^window
+	uint32_t trailing;			// squarings after the last step
+	uint64_t count;				// number of steps
+	struct intExponentStep steps[];
+};
+
+// Recode the exponent held in y into sliding windows of the given width:
+//  Returns the number of steps, writing them and the trailing squarings to plan if it isn't 0.
+static uint64_t exponentRecode(
+    const uint64_t* y,				// exponent, n limbs
+    uint32_t n,						// limbs
+    uint32_t window,				// bits per window
+    struct intExponentPlan* plan	// receives the steps; may be 0
+) {
+	uint64_t count = 0;
+	uint32_t squarings = 0;
+	int64_t i = (int64_t) n * INT_SIZE - 1;
+	while (i >= 0) {
+		if (!(y[i / INT_SIZE] >> (i % INT_SIZE) & 0x1)) {
+			squarings++;
+			i--;
+			continue;
+		}
+		// Take the longest window starting at bit i that fits and ends in a set bit:
+		int64_t j = i - window + 1;
+		if (j < 0) {
+			j = 0;
+		}
+		while (!(y[j / INT_SIZE] >> (j % INT_SIZE) & 0x1)) {
+			j++;
+		}
+		uint32_t digit = 0;
+		int64_t k;
+		for (k = i; k >= j; k--) {
+			digit = digit << 1 | (uint32_t) (y[k / INT_SIZE] >> (k % INT_SIZE) & 0x1);
+		}
+		if (plan) {
+			plan->steps[count].squarings = squarings + (uint32_t) (i - j + 1);
+			plan->steps[count].digit = digit;
+		}
+		count++;
+		squarings = 0;
+		i = j - 1;
+	}
+	if (plan) {
+		plan->trailing = squarings;
+	}
+	return count;
+} // O(n)
+
+// Given a fixed exponent Y, compute its sliding-window schedule once:
+//  The window is the one that minimizes table multiplications plus step multiplications for Y.
+struct intExponentPlan* intExponentPlanMake(
+    const struct intChain* Y	// exponent
+) {
+	assert(!intCheck(Y));
+	uint32_t n = Y->size;
+	uint64_t y[n + 1];
+	fixedFromChain(y, Y, n);
+	uint32_t window = 1;
+	uint64_t count = exponentRecode(y, n, 1, 0);
+	uint32_t w;
+	for (w = 2; w <= INT_EXPONENT_WINDOW; w++) {
+		uint64_t steps = exponentRecode(y, n, w, 0);
+		// The table of odd powers costs a squaring and 2^(w-1) - 1 multiplications:
+		if (steps + ((uint64_t) 1 << (w - 1)) < count + ((uint64_t) 1 << (window - 1))) {
+			window = w;
+			count = steps;
+		}
+	}
+	struct intExponentPlan* plan = malloc(sizeof * plan + count * sizeof * plan->steps);
+	if (!plan) {
+		exit(1);
+	}
+	STAT(mallocs, 1);
+	plan->window = window;
+	plan->count = exponentRecode(y, n, window, plan);
+	return plan;
+} // O(|Y|)
+
+// Free a plan made by intExponentPlanMake:
+void intExponentPlanFree(
+    struct intExponentPlan* plan	// plan to be freed
+) {
+	free(plan);
+	STAT(frees, 1);
+} // O(1)
+
+// Return the bytes held by a plan:
+uint64_t intExponentPlanBytes(
+    const struct intExponentPlan* plan	// plan to measure
+) {
+	return sizeof * plan + plan->count * sizeof * plan->steps;
+} // O(1)
+
+// Given X and a planned exponent, return X^Y mod M:
+//  Precomputes the odd powers of X up to the plan's window, then runs the steps.
+struct intChain* intModulusExpPlan(
+    const struct intChain* X,				// base
+    const struct intExponentPlan* plan,		// schedule of the exponent
+    const struct intModulus* M				// constants of the modulus
+) {
+	assert(!intCheck(X));
+	uint32_t n = M->limbs;
+	uint32_t entries = (uint32_t) 1 << (plan->window - 1);
+	uint64_t table[entries * n];	// X^(2j + 1) for every j, in Montgomery form
+	uint64_t result[n];
+	modulusLoad(M, table, X);
+	M->multiply(table, table, M->conversion, M);
+	if (entries > 1) {
+		M->square(result, table, M);
+		uint32_t j;
+		for (j = 1; j < entries; j++) {
+			M->multiply(table + j * n, table + (j - 1) * n, result, M);
+		}
+	}
+	if (!plan->count) {
+		memcpy(result, M->one, sizeof result);
+	} else {
+		memcpy(result, table + (plan->steps[0].digit >> 1) * n, sizeof result);
+	}
+	uint64_t k;
+	for (k = 1; k < plan->count; k++) {
+		uint32_t squarings = plan->steps[k].squarings;
+		while (squarings--) {
+			M->square(result, result, M);
+		}
+		M->multiply(result, result, table + (plan->steps[k].digit >> 1) * n, M);
+	}
+	uint32_t trailing = plan->trailing;
+	while (trailing--) {
+		M->square(result, result, M);
+	}
+	return modulusStore(M, result);
+} // O(|Y| n^2)
+
+// Return whether Z is odd and of a standard key size or pseudo-Mersenne, the moduli that take the fixed-width path:
+static uint32_t fixedWidthModulus(
+    const struct intChain* Z	// modulus
+) {
+	return (Z->next->data & 0x1) && (Z->size == 32 || Z->size == 48 || Z->size == 64 || foldOffset(Z));
+} // O(|Z|)
+
 struct intChain* intModExp(
-    struct intChain* X,	// base
-    struct intChain* Y,	// exponent
-    struct intChain* Z	// modulus
+    const struct intChain* X,	// base
+    const struct intChain* Y,	// exponent
+    const struct intChain* Z	// modulus
 ) {
 	assert(!intCheck(X));
 	assert(!intCheck(Y));
 	assert(!intCheck(Z));
-	struct intChain* W = intCopy(X);
+	STAT(calls[INT_STATS_MODEXP], 1);
+	STAT(limbs[INT_STATS_MODEXP], X->size + Y->size + Z->size);
+	if (fixedWidthModulus(Z)) {
+		struct intModulus* M = intModulusMake(Z);
+		struct intChain* Result = intModulusExp(X, Y, M);
+		intModulusFree(M);
+		return Result;
+	}
+	// Shares cost nothing for shareable operands such as key material, and are only copied if reduced below:
+	struct intChain* W = intShare(X);
 	// X to a power of two.
-	struct intChain* Result = intCopy(&chainOne);
+	struct intChain* Result = intMake();
+	// A one of its own, held inline, rather than a share that every thread would count on chainOne:
+	intIncrement(Result);
 	// For every node in Y:
 	struct intNode* currentNodeY = Y->next;
 	while (currentNodeY != &rootZero) {
@@ -766,6 +1927,108 @@ struct intChain* intModExp(
 	return Result;
 }
 
+// Given a table of X^(2^i) mod Z for i = 0, 1, 2..., return X^Y mod Z:
+//  Each entry is stored as limbs little-endian 64-bit limbs, and the table needs an entry for every bit of Y.
+//  Replaces the squarings of intModExp with table lookups, leaving one multiplication per set bit of Y.
+struct intChain* intModExpTable(
+    const uint8_t* table,	// precomputed powers of the base
+    uint64_t limbs,			// limbs per table entry
+    uint64_t entries,		// number of entries in the table
+    const struct intChain* Y,		// exponent
+    const struct intChain* Z		// modulus
+) {
+	assert(table);
+	assert(!intCheck(Y));
+	assert(!intCheck(Z));
+	// Every set bit of Y needs a table entry:
+	assert(Y->next == &rootZero || intMagnitude(Y) < (int64_t) entries);
+	(void) entries;
+	STAT(calls[INT_STATS_MODEXP_TABLE], 1);
+	STAT(limbs[INT_STATS_MODEXP_TABLE], Y->size + Z->size);
+	if (fixedWidthModulus(Z) && limbs >= Z->size) {
+		struct intModulus* M = intModulusMake(Z);
+		struct intChain* Result = intModulusExpTable(table, limbs, entries, Y, M);
+		intModulusFree(M);
+		return Result;
+	}
+	struct intChain* Result = intMake();
+	intIncrement(Result);
+	struct intNode* currentNodeY = Y->next;
+	while (currentNodeY != &rootZero) {
+		uint64_t nodeBits = currentNodeY->data;
+		const uint8_t* entry = table;
+		while (nodeBits) {
+			if (nodeBits & 0x1) {
+				struct intChain* Power = intFromLimbs(entry, limbs);
+				struct intChain* Product = intMult(Result, Power);
+				intMod(Product, Z);
+				intFree(Result);
+				intFree(Power);
+				Result = Product;
+			}
+			entry += 8 * limbs;
+			nodeBits >>= 1;
+		}
+		table += 8 * limbs * INT_SIZE;
+		currentNodeY = currentNodeY->next;
+	}
+	return Result;
+}
+
+// Given a table of X^(2^i) mod M as for intModExpTable, return X^Y mod M:
+//  Entries are multiplied in as they are, so each Montgomery multiplication leaves a factor of R^-1 behind;
+//  the k of them are cancelled at the end by one multiplication by R^(k+1), itself a short power of R.
+struct intChain* intModulusExpTable(
+    const uint8_t* table,		// precomputed powers of the base
+    uint64_t limbs,				// limbs per table entry, at least the limbs of the modulus
+    uint64_t entries,			// number of entries in the table
+    const struct intChain* Y,	// exponent
+    const struct intModulus* M	// constants of the modulus
+) {
+	assert(table);
+	assert(!intCheck(Y));
+	// Entries are below the modulus, so any limbs past its own are zero:
+	assert(limbs >= M->limbs);
+	assert(Y->next == &rootZero || intMagnitude(Y) < (int64_t) entries);
+	(void) entries;
+	uint32_t n = M->limbs;
+	uint64_t result[n];
+	uint64_t power[n];
+	memcpy(result, M->one, sizeof result);
+	uint64_t multiplications = 0;
+	const struct intNode* currentNodeY = Y->next;
+	while (currentNodeY != &rootZero) {
+		uint64_t nodeBits = currentNodeY->data;
+		const uint8_t* entry = table;
+		while (nodeBits) {
+			if (nodeBits & 0x1) {
+				fixedFromBytes(power, entry, n);
+				M->multiply(result, result, power, M);
+				multiplications++;
+			}
+			entry += 8 * limbs;
+			nodeBits >>= 1;
+		}
+		table += 8 * limbs * INT_SIZE;
+		currentNodeY = currentNodeY->next;
+	}
+	// result is now X^Y R^(1 - k); R^(k+1) is the Montgomery form of R^k, and R^2 that of R:
+	uint64_t correction[n];
+	memcpy(correction, M->one, sizeof correction);
+	memcpy(power, M->conversion, sizeof power);
+	while (multiplications) {
+		if (multiplications & 0x1) {
+			M->multiply(correction, correction, power, M);
+		}
+		multiplications >>= 1;
+		if (multiplications) {
+			M->square(power, power, M);
+		}
+	}
+	M->multiply(result, result, correction, M);
+	return modulusStore(M, result);
+} // O(|Y| n^2)
+
 // Generate an intChain of size k filled with high quality random data:
 static struct intChain* intCryptoRandomNodes(
     uint64_t k		// size of intChain to return
@@ -776,6 +2039,7 @@ static struct intChain* intCryptoRandomNodes(
 		volatile uint8_t randomData[INT_SIZE / 4];
 		// Volatile prevents the compiler from doing crazy things.
 		syscall(SYS_getrandom, &randomData, INT_SIZE / 4, 0);
+		STAT(getrandomCalls, 1);
 		// Reads from dev/urandom on Linux.
 		uint32_t j = INT_SIZE / 8;
 		uint64_t newData = 0;
@@ -785,7 +2049,7 @@ static struct intChain* intCryptoRandomNodes(
 			newData += randomData[j];
 		}
 		// Put that data into a new node:
-		struct intNode* newNode = nodeMake();
+		struct intNode* newNode = nodeMake(Y);
 		newNode->data = newData;
 		Y->last->next = newNode;
 		Y->last = newNode;
@@ -794,7 +2058,7 @@ static struct intChain* intCryptoRandomNodes(
 			lastNonZeroNode = newNode;
 		}
 	}
-	Y->size -= nodeFree(lastNonZeroNode->next);
+	Y->size -= nodeFree(Y, lastNonZeroNode->next);
 	Y->last = lastNonZeroNode;
 	lastNonZeroNode->next = &rootZero;
 	return Y;
@@ -802,7 +2066,7 @@ static struct intChain* intCryptoRandomNodes(
 
 // Generate an intChain between zero and X filled with high quality random data:
 struct intChain* intCryptoRandom(
-    struct intChain* X	// Upper bound for random value
+    const struct intChain* X	// Upper bound for random value
 ) {
 	assert(!intCheck(X));
 	struct intChain* Y = intCryptoRandomNodes(X->size);
@@ -815,7 +2079,7 @@ struct intChain* intCryptoRandom(
 // Generate an intChain between zero and X filled with low quality random data:
 //  Faster and less taxing on system resources.
 struct intChain* intPseudoRandom(
-    struct intChain* X	// Upper bound for random value
+    const struct intChain* X	// Upper bound for random value
 ) {
 	assert(!intCheck(X));
 	struct intChain* Y = intMake();
@@ -831,7 +2095,7 @@ struct intChain* intPseudoRandom(
 			newData += rand();
 		}
 		// Put that data into a new node:
-		struct intNode* newNode = nodeMake();
+		struct intNode* newNode = nodeMake(Y);
 		newNode->data = newData;
 		Y->last->next = newNode;
 		Y->last = newNode;
@@ -840,7 +2104,7 @@ struct intChain* intPseudoRandom(
 			lastNonZeroNode = newNode;
 		}
 	}
-	Y->size -= nodeFree(lastNonZeroNode->next);
+	Y->size -= nodeFree(Y, lastNonZeroNode->next);
 	Y->last = lastNonZeroNode;
 	lastNonZeroNode->next = &rootZero;
 	intMod(Y, X);
@@ -857,14 +2121,22 @@ struct intChain* intPseudoRandom(
 // Test whether a given intChain is prime, to confidence 1 - 4^(-confidence):
 //  Uses the Miller-Rabin algorithm.
 uint32_t intIsPrime(
-    struct intChain* X	// potential prime to be tested
+    const struct intChain* X	// potential prime to be tested
 ) {
-	struct intChain* XMinusOne = intCopy(X);
+	STAT(calls[INT_STATS_ISPRIME], 1);
+	STAT(limbs[INT_STATS_ISPRIME], X->size);
+	struct intChainStorage xMinusOneStorage;
+	struct intChainStorage xMinusTwoStorage;
+	struct intChainStorage oddPartStorage;
+	struct intChain* XMinusOne = intInit(&xMinusOneStorage);
+	intAdd(XMinusOne, X);
 	intDecrement(XMinusOne);
-	struct intChain* XMinusTwo = intCopy(XMinusOne);
+	struct intChain* XMinusTwo = intInit(&xMinusTwoStorage);
+	intAdd(XMinusTwo, XMinusOne);
 	intDecrement(XMinusTwo);
 	uint32_t twoExponent = 0;
-	struct intChain* OddPart = intCopy(XMinusOne);
+	struct intChain* OddPart = intInit(&oddPartStorage);
+	intAdd(OddPart, XMinusOne);
 	while (intIsEven(OddPart)) {
 		intRShift(OddPart, 1);
 		twoExponent++;
@@ -872,12 +2144,16 @@ uint32_t intIsPrime(
 	uint64_t confidence = PRIME_CONFIDENCE;
 MAYBE_PRIME:
 	while (confidence--) {
+		// Each round is traced from here to whichever goto ends it:
+		uint64_t roundStart = traceBegin();
+		int64_t round = PRIME_CONFIDENCE - 1 - confidence;
 		struct intChain* Witness = intPseudoRandom(XMinusTwo);
 		struct intChain* Swap = intModExp(Witness, OddPart, X);
 		intFree(Witness);
 		Witness = Swap;
 		if (intFineCompare(Witness, &chainOne) == 0 || intFineCompare(Witness, XMinusOne) == 0) {
 			intFree(Witness);
+			traceEnd("millerRabinRound", roundStart, round);
 			goto MAYBE_PRIME;
 		}
 		uint32_t currentExponent = twoExponent;
@@ -894,20 +2170,22 @@ MAYBE_PRIME:
 			} else */
 			if (intFineCompare(Witness, XMinusOne) == 0) {
 				intFree(Witness);
+				traceEnd("millerRabinRound", roundStart, round);
 				goto MAYBE_PRIME;
 			}
 		}
 		intFree(Witness);
+		traceEnd("millerRabinRound", roundStart, round);
 		goto NOT_PRIME;
 	}
-	intFree(XMinusOne);
-	intFree(XMinusTwo);
-	intFree(OddPart);
+	intRelease(XMinusOne);
+	intRelease(XMinusTwo);
+	intRelease(OddPart);
 	return 1;
 NOT_PRIME:
-	intFree(XMinusOne);
-	intFree(XMinusTwo);
-	intFree(OddPart);
+	intRelease(XMinusOne);
+	intRelease(XMinusTwo);
+	intRelease(OddPart);
 	return 0;
 }
 
@@ -917,22 +2195,32 @@ struct intChain* intMakePrime(
     uint64_t size		// order of magnitude for prime to be generated
 ) {
 	assert(size > 2);
-	struct intChain* LowerBound = intMake();
+	STAT(calls[INT_STATS_MAKEPRIME], 1);
+	struct intChainStorage lowerBoundStorage;
+	struct intChainStorage upperBoundStorage;
+	struct intChain* LowerBound = intInit(&lowerBoundStorage);
 	intIncrement(LowerBound);
 	intLShift(LowerBound, size - 1);
 	// LowerBound is now 2^size.
-	struct intChain* UpperBound = intCopy(LowerBound);
+	struct intChain* UpperBound = intInit(&upperBoundStorage);
+	intAdd(UpperBound, LowerBound);
 	intLShift(UpperBound, 1);
 	// UpperBound is now 2^(size+1).
+	uint64_t searchStart = traceBegin();
+	uint64_t candidateStart = traceBegin();
+	int64_t candidates = 1;
 	struct intChain* X = intCryptoRandom(LowerBound);
 	intLShift(X, 1);
 	intIncrement(X);
+	traceEnd("candidateGeneration", candidateStart, candidates);
 	uint32_t isRandom = 1;
 	while (
 	    intFineCompare(LowerBound, X) != 2 ||
 	    intFineCompare(X, UpperBound) != 2 ||
 	    !intIsPrime(X)
 	) {
+		candidateStart = traceBegin();
+		candidates++;
 		if (isRandom) {
 			intLShift(X, 1);
 			intIncrement(X);
@@ -945,44 +2233,208 @@ struct intChain* intMakePrime(
 			intIncrement(X);
 			isRandom = 1;
 		}
+		traceEnd("candidateGeneration", candidateStart, candidates);
 	}
-	intFree(LowerBound);
-	intFree(UpperBound);
+	traceEnd("primeSearch", searchStart, candidates);
+	intRelease(LowerBound);
+	intRelease(UpperBound);
 	return X;
 }
 
-// Find and return a primitive root mod a prime P:
-//  Securely random.
-struct intChain* intFindPrimitiveRoot(
-    struct intChain* P	// Prime to find a primitive root of
+// Small odd primes sieved out of pseudo-Mersenne candidates before any Miller-Rabin round:
+#define SIEVE_BOUND (1 << 14)
+
+// Return 2^e mod r for a small r:
+static uint64_t powerOfTwoMod(
+    uint64_t e,
+    uint64_t r
+) {
+	uint64_t result = 1 % r;
+	uint64_t base = 2 % r;
+	while (e) {
+		if (e & 0x1) {
+			result = result * base % r;
+		}
+		base = base * base % r;
+		e >>= 1;
+	}
+	return result;
+} // O(log(e))
+
+// Find and return the largest safe prime p = 2^(64n) - c with c below 2^32, storing c to offset:
+//  p = 2q + 1 with q prime, so the factors of p - 1 are known and intFindGenerator can check a generator against
+//  them. Candidates are tried downward from 2^size - 1 in steps of 4, keeping p = 3 mod 4 so that q is odd, and any
+//  whose p or q has a factor below SIEVE_BOUND is skipped from residues kept up to date with each step.
+//  Returns 0 if no c below 2^32 works.
+struct intChain* intMakePseudoMersennePrime(
+    uint64_t size,		// bits in the prime, a multiple of 64
+    uint64_t* offset	// receives c
+) {
+	assert(size >= 2 * INT_SIZE && size % INT_SIZE == 0);
+	STAT(calls[INT_STATS_MAKEPRIME], 1);
+	uint64_t searchStart = traceBegin();
+	// Odd primes below the bound, and the candidate's residue mod each:
+	uint8_t* composite = calloc(SIEVE_BOUND, 1);
+	uint32_t* primes = malloc(SIEVE_BOUND * sizeof * primes);
+	uint32_t* residues = malloc(SIEVE_BOUND * sizeof * residues);
+	if (!composite || !primes || !residues) {
+		exit(1);
+	}
+	STAT(mallocs, 3);
+	uint32_t primeCount = 0;
+	uint32_t r;
+	for (r = 3; r < SIEVE_BOUND; r += 2) {
+		if (composite[r]) {
+			continue;
+		}
+		uint32_t multiple;
+		for (multiple = 3 * r; multiple < SIEVE_BOUND; multiple += 2 * r) {
+			composite[multiple] = 1;
+		}
+		primes[primeCount] = r;
+		residues[primeCount] = (powerOfTwoMod(size, r) + r - 1) % r;
+		primeCount++;
+	}
+	struct intChain* X = intMake();
+	intIncrement(X);
+	intLShift(X, size);
+	intDecrement(X);
+	// X is now 2^size - 1.
+	struct intChainStorage halfStorage;
+	struct intChain* Half = intInit(&halfStorage);
+	uint64_t c = 1;
+	int64_t candidates = 0;
+	while (1) {
+		// p has a small factor r if it is 0 mod r, and q = (p - 1) / 2 does if p is 1 mod r:
+		uint32_t j;
+		for (j = 0; j < primeCount && residues[j] > 1; j++);
+		if (j == primeCount) {
+			candidates++;
+			if (intIsPrime(X)) {
+				intRelease(Half);
+				Half = intInit(&halfStorage);
+				intAdd(Half, X);
+				intRShift(Half, 1);
+				if (intIsPrime(Half)) {
+					break;
+				}
+			}
+		}
+		// Fail rather than hand back a modulus the folding reduction can't take:
+		if (c + 4 >= FOLD_LIMIT) {
+			intFree(X);
+			X = 0;
+			break;
+		}
+		intDecrement(X);
+		intDecrement(X);
+		intDecrement(X);
+		intDecrement(X);
+		c += 4;
+		for (j = 0; j < primeCount; j++) {
+			residues[j] = (residues[j] + primes[j] - 4 % primes[j]) % primes[j];
+		}
+	}
+	intRelease(Half);
+	free(composite);
+	free(primes);
+	free(residues);
+	STAT(frees, 3);
+	traceEnd("primeSearch", searchStart, candidates);
+	*offset = X ? c : 0;
+	return X;
+}
+
+// Find and return a generator mod a prime P, given every prime factor of P - 1:
+//  G generates the whole group exactly when G^((P - 1) / f) isn't 1 for any prime factor f. Securely random,
+//  between 2 and P - 2.
+struct intChain* intFindGenerator(
+    const struct intChain* P,			// prime to find a generator of
+    const struct intChain** Factors,	// distinct prime factors of P - 1
+    uint64_t factorCount				// number of factors
 ) {
 	assert(!intCheck(P));
-	assert(intIsPrime(P));
 	struct intChain* Phi = intCopy(P);
 	intDecrement(Phi);
-	struct intChain* G = intCryptoRandom(Phi);
-	struct intChain* W = intModExp(G, Phi, P);
-	while (intCompare(&chainOne, W)) {
+	struct intChain* Range = intCopy(Phi);
+	intDecrement(Range);
+	intDecrement(Range);
+	// Exponents (P - 1) / f:
+	struct intChain** Cofactors = malloc(factorCount * sizeof * Cofactors);
+	if (!Cofactors) {
+		exit(1);
+	}
+	STAT(mallocs, 1);
+	uint64_t j;
+	for (j = 0; j < factorCount; j++) {
+		assert(!intCheck(Factors[j]));
+		// intDiv leaves the remainder behind, which is zero here:
+		struct intChain* Remainder = intCopy(Phi);
+		Cofactors[j] = intDiv(Remainder, Factors[j]);
+		intFree(Remainder);
+	}
+	struct intChainStorage oneStorage;
+	struct intChain* One = intInit(&oneStorage);
+	intIncrement(One);
+	int64_t attempts = 0;
+	struct intChain* G;
+	while (1) {
+		uint64_t attemptStart = traceBegin();
+		attempts++;
+		G = intCryptoRandom(Range);
+		intIncrement(G);
+		intIncrement(G);
+		uint32_t isGenerator = 1;
+		for (j = 0; j < factorCount && isGenerator; j++) {
+			struct intChain* W = intModExp(G, Cofactors[j], P);
+			isGenerator = intFineCompare(W, One) != 0;
+			intFree(W);
+		}
+		traceEnd("primitiveRootAttempt", attemptStart, attempts);
+		if (isGenerator) {
+			break;
+		}
 		intFree(G);
-		intFree(W);
-		G = intCryptoRandom(P);
-		W = intModExp(G, Phi, P);
 	}
+	for (j = 0; j < factorCount; j++) {
+		intFree(Cofactors[j]);
+	}
+	free(Cofactors);
+	STAT(frees, 1);
+	intRelease(One);
+	intFree(Range);
 	intFree(Phi);
-	intFree(W);
+	return G;
+}
+
+// Find and return a primitive root mod a prime P:
+//  Securely random. Only the factor 2 of P - 1 is known here, so G is checked to be a quadratic non-residue,
+//  which every primitive root is; when the other factors are known, intFindGenerator checks them all.
+struct intChain* intFindPrimitiveRoot(
+    const struct intChain* P	// Prime to find a primitive root of
+) {
+	assert(!intCheck(P));
+	assert(intIsPrime(P));
+	struct intChainStorage twoStorage;
+	struct intChain* Two = intInit(&twoStorage);
+	intIncrement(Two);
+	intIncrement(Two);
+	const struct intChain* Factors[1] = {Two};
+	struct intChain* G = intFindGenerator(P, Factors, 1);
+	intRelease(Two);
 	return G;
 }
 
 // Encode a string 
 struct intChain* intEncodeString(
-    char* buffer
+    const char* buffer
 ) {
 	assert(buffer);
 	struct intChain* X = intMake();
 	struct intNode* lastNonZeroNode = (struct intNode*) X;
 	uint32_t stillRunning = 1;
 	while (stillRunning) {
-		struct intNode* newNode = nodeMake();
+		struct intNode* newNode = nodeMake(X);
 		X->last->next = newNode;
 		X->last = newNode;
 		X->size++;
@@ -1001,17 +2453,18 @@ struct intChain* intEncodeString(
 			lastNonZeroNode = newNode;
 		}
 	}
-	X->size -= nodeFree(lastNonZeroNode->next);
+	X->size -= nodeFree(X, lastNonZeroNode->next);
 	X->last = lastNonZeroNode;
 	lastNonZeroNode->next = &rootZero;
 	return X;
 }
 
 char* intDecodeString(
-    struct intChain* X	// Prime to find a primitive root of
+    const struct intChain* X	// Prime to find a primitive root of
 ) {
 	assert(!intCheck(X));
 	char* buffer = malloc((X->size + 1) * INT_SIZE / 8 + 1);
+	STAT(mallocs, 1);
 	char* bufferLoc = buffer;
 	struct intNode* currentNode = X->next;
 	while (currentNode != &rootZero) {
@@ -1027,99 +2480,318 @@ char* intDecodeString(
 	return buffer;
 }
 
-// Given an intNode, recursively convert it and subsequent nodes into a little-endian hex string; return a pointer to the end of the string:
-static char* textify(
-    struct intNode* currentNode,
+// Hex digits, indexed by value:
+static const char hexDigits[16] = "0123456789ABCDEF";
+
+// Values of hex digits plus one, indexed by character; zero marks a non-digit:
+static const uint8_t hexValues[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};
+
+// Write a node's data as 16 big-endian hex digits:
+static void hexFromData(
+    uint64_t data,
     char* buffer
 ) {
-	assert(currentNode && buffer);
-	if (currentNode == &rootZero) {
-		return buffer;
-	}
-	uint64_t data = currentNode->data;
+#if defined(__SSSE3__) && defined(__x86_64__)
+	// Split the big-endian bytes into nibbles, interleave them, and look all 16 digits up at once:
+	__m128i bytes = _mm_cvtsi64_si128((int64_t) __builtin_bswap64(data));
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+	__m128i low = _mm_and_si128(bytes, mask);
+	__m128i nibbles = _mm_unpacklo_epi8(high, low);
+	__m128i table = _mm_loadu_si128((const __m128i*) hexDigits);
+	_mm_storeu_si128((__m128i*) buffer, _mm_shuffle_epi8(table, nibbles));
+#else
 	uint32_t currentNibble = 16;
-	*(buffer++) = ' ';
 	while (currentNibble--) {
-		char currentDigit = data & 0x0000000F;
-		if (currentDigit < 10) {
-			currentDigit += 48;
-		} else {
-			currentDigit += 55;
-		}
-		*(buffer++) = currentDigit;
+		buffer[currentNibble] = hexDigits[data & 0x0F];
 		data >>= 4;
 	}
-	return textify(currentNode->next, buffer);
-} // O(|currentNode|)
+#endif
+} // O(1)
 
-// Given an intChain X, convert it to a big-endian string:
-char* intToString(
-    struct intChain* X
+#if defined(__SSSE3__) && defined(__x86_64__)
+// Read 16 hex digits as a node's data, returning 0 if any of them isn't a hex digit:
+static uint32_t hexToData(
+    const char* buffer,
+    uint64_t* data
+) {
+	__m128i characters = _mm_loadu_si128((const __m128i*) buffer);
+	// Classify each byte as a decimal digit or a letter, in either case:
+	__m128i digits = _mm_sub_epi8(characters, _mm_set1_epi8('0'));
+	__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+	__m128i letters = _mm_sub_epi8(_mm_or_si128(characters, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(5)), letters);
+	if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF) {
+		return 0;
+	}
+	__m128i values = _mm_or_si128(
+	    _mm_and_si128(isDigit, digits),
+	    _mm_and_si128(isLetter, _mm_add_epi8(letters, _mm_set1_epi8(10)))
+	);
+	// Fold pairs of nibbles into bytes (16 * high + low), then pack the bytes together:
+	__m128i bytes = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0110));
+	bytes = _mm_packus_epi16(bytes, bytes);
+	*data = __builtin_bswap64((uint64_t) _mm_cvtsi128_si64(bytes));
+	return 1;
+} // O(1)
+#endif
+
+// Return the number of bytes intWriteString needs to write X, including the terminating NUL:
+uint64_t intStringLength(
+    const struct intChain* X
 ) {
 	assert(!intCheck(X));
-	char* buffer;
 	if (X->next == &rootZero) {
-		buffer = malloc(2);
-		assert(buffer);
+		return 2;
+	}
+	// 16 digits per node, a space between nodes, and the NUL:
+	return 17 * X->size;
+} // O(1)
+
+// Given an intChain X, write it into a caller-supplied buffer as a big-endian string:
+//  The buffer must hold at least intStringLength(X) bytes.
+char* intWriteString(
+    const struct intChain* X,
+    char* buffer
+) {
+	assert(!intCheck(X));
+	assert(buffer);
+	if (X->next == &rootZero) {
 		buffer[0] = '0';
 		buffer[1] = 0;
 		return buffer;
 	}
-	buffer = malloc(17 * (X->size));
-	assert(buffer);
-	char* swapRight = textify(X->next, buffer) - 1;
-	char* swapLeft = buffer;
-	*(swapLeft) = 0;
-	while (swapLeft < swapRight) {
-		char swapChar = *swapLeft;
-		*swapLeft = *swapRight;
-		*swapRight = swapChar;
-		swapLeft++;
-		swapRight--;
+	// Fill the buffer from the back, least significant node first:
+	char* position = buffer + intStringLength(X) - 1;
+	*position = 0;
+	struct intNode* currentNode = X->next;
+	while (currentNode != &rootZero) {
+		position -= 16;
+		hexFromData(currentNode->data, position);
+		currentNode = currentNode->next;
+		if (currentNode != &rootZero) {
+			*(--position) = ' ';
+		}
 	}
 	return buffer;
 } // O(|X|)
 
-// Given a hex-string representing an integer, allocate an intChain capable of holding the represented integer, and fill it with the given data:
-struct intChain* intFromString(
-    char* buffer
+// Given an intChain X, convert it to a big-endian string:
+char* intToString(
+    const struct intChain* X
 ) {
+	char* buffer = malloc(intStringLength(X));
+	STAT(mallocs, 1);
 	assert(buffer);
+	return intWriteString(X, buffer);
+} // O(|X|)
+
+// Given a buffer of hex digits, allocate an intChain holding the represented integer:
+//  Anything other than a hex digit is skipped, so the spaces intToString puts between nodes are fine.
+struct intChain* intFromHex(
+    const char* buffer,
+    uint64_t length
+) {
+	assert(buffer || length == 0);
 	struct intChain* X = intMake();
-	struct intNode* currentNode = &rootZero;
-	struct intNode* lastNode = (struct intNode*) X;
-	uint64_t nodeCount = 0;
-	uint32_t currentNibble = 0;
-	char* currentBufferLocation = buffer;
-	while (*currentBufferLocation != 0) {
-		char currentDigit = *(currentBufferLocation++);
-		if (currentDigit >= 48 && currentDigit <= 57) {
-			currentDigit -= 48;
-		} else if (currentDigit >= 65 && currentDigit <= 70) {
-			currentDigit -= 55;
-		} else {
-			continue;
+	struct intNode* lastNonZeroNode = (struct intNode*) X;
+	uint64_t data = 0;
+	uint32_t shift = 0;
+	// Walk backwards from the least significant digit, filling one node at a time:
+	const char* position = buffer + length;
+	while (position != buffer || shift) {
+		uint32_t complete = (position == buffer);
+#if defined(__SSSE3__) && defined(__x86_64__)
+		if (!complete && shift == 0 && position - buffer >= 16 && hexToData(position - 16, &data)) {
+			// A whole node's worth of digits in one step:
+			position -= 16;
+			complete = 1;
 		}
-		if (lastNode == (struct intNode*) X && currentDigit == 0) {
-			continue;
+#endif
+		if (!complete) {
+			uint64_t value = hexValues[(uint8_t) *(--position)];
+			if (value == 0) {
+				continue;
+			}
+			data += (value - 1) << shift;
+			shift += 4;
+			complete = (shift == INT_SIZE);
 		}
-		if (currentNibble == 0) {
-			struct intNode* newNode = nodeMake();
-			newNode->next = currentNode;
-			currentNode = newNode;
-			if (lastNode == (struct intNode*) X) {
-				lastNode = currentNode;
+		if (complete) {
+			struct intNode* newNode = nodeMake(X);
+			newNode->data = data;
+			X->last->next = newNode;
+			X->last = newNode;
+			X->size++;
+			if (data != 0) {
+				lastNonZeroNode = newNode;
 			}
-			currentNibble = INT_SIZE / 4;
-			nodeCount++;
+			data = 0;
+			shift = 0;
 		}
-		currentNibble--;
-		currentNode->data += (uint64_t) currentDigit << 4 * currentNibble;
 	}
-	X->next = currentNode;
-	X->last = lastNode;
-	X->size = nodeCount;
-	intRShift(X, 4 * currentNibble);
+	// Trim the nodes made from leading zeroes:
+	X->size -= nodeFree(X, lastNonZeroNode->next);
+	X->last = lastNonZeroNode;
+	lastNonZeroNode->next = &rootZero;
 	return X;
+} // O(|buf|)
+
+// Given a hex-string representing an integer, allocate an intChain capable of holding the represented integer, and fill it with the given data:
+struct intChain* intFromString(
+    const char* buffer
+) {
+	assert(buffer);
+	return intFromHex(buffer, strlen(buffer));
 } // O(|buf| + |X|)
 
+// Given an intChain X, write it into a buffer as exactly n little-endian 64-bit limbs:
+//  Returns 0 on success, or 1 if X is too large to fit in n limbs.
+uint32_t intToLimbs(
+    const struct intChain* X,	// intChain to be written
+    uint8_t* buffer,	// buffer of at least 8 * n bytes
+    uint64_t n			// number of limbs to write
+) {
+	assert(!intCheck(X));
+	assert(buffer);
+	if (X->size > n) {
+		return 1;
+	}
+	struct intNode* currentNode = X->next;
+	while (n--) {
+		// Past the end of X, currentNode sits on rootZero and pads the record with zeroes:
+		uint64_t data = currentNode->data;
+		uint32_t j = INT_SIZE / 8;
+		while (j--) {
+			*(buffer++) = (uint8_t) data;
+			data >>= 8;
+		}
+		currentNode = currentNode->next;
+	}
+	return 0;
+} // O(n)
+
+// Given a buffer of n little-endian 64-bit limbs, allocate an intChain holding the represented integer:
+struct intChain* intFromLimbs(
+    const uint8_t* buffer,	// buffer of at least 8 * n bytes
+    uint64_t n				// number of limbs to read
+) {
+	assert(buffer);
+	struct intChain* X = intMake();
+	struct intNode* lastNonZeroNode = (struct intNode*) X;
+	while (n--) {
+		uint64_t data = 0;
+		uint32_t j = INT_SIZE / 8;
+		while (j--) {
+			data <<= 8;
+			data += buffer[j];
+		}
+		buffer += INT_SIZE / 8;
+		struct intNode* newNode = nodeMake(X);
+		newNode->data = data;
+		X->last->next = newNode;
+		X->last = newNode;
+		X->size++;
+		if (data != 0) {
+			lastNonZeroNode = newNode;
+		}
+	}
+	// Trim the high zero limbs:
+	X->size -= nodeFree(X, lastNonZeroNode->next);
+	X->last = lastNonZeroNode;
+	lastNonZeroNode->next = &rootZero;
+	return X;
+} // O(n)
+
+// Given an intChain X and a seed, return a 64-bit FNV-1a hash of X's limbs:
+//  Chain calls through the seed to fingerprint several intChains together.
+uint64_t __attribute__((pure)) intHash(
+    const struct intChain* X,	// intChain to be hashed
+    uint64_t seed		// previous hash value, or zero to start fresh
+) {
+	assert(!intCheck(X));
+	uint64_t hash = seed ? seed : 0xCBF29CE484222325;
+	struct intNode* currentNode = X->next;
+	while (currentNode != &rootZero) {
+		uint64_t data = currentNode->data;
+		uint32_t j = INT_SIZE / 8;
+		while (j--) {
+			hash ^= (uint8_t) data;
+			hash *= 0x00000100000001B3;
+			data >>= 8;
+		}
+		currentNode = currentNode->next;
+	}
+	// Fold in the length so that chains differing only by zero limbs can't collide:
+	hash ^= X->size;
+	hash *= 0x00000100000001B3;
+	return hash;
+} // O(|X|)
+
+// Given a buffer of n bytes holding a big-endian integer, allocate an intChain holding the represented integer:
+struct intChain* intFromBytes(
+    const uint8_t* buffer,	// buffer of at least n bytes
+    uint64_t n				// number of bytes to read
+) {
+	assert(buffer || n == 0);
+	struct intChain* X = intMake();
+	struct intNode* lastNonZeroNode = (struct intNode*) X;
+	// Walk backwards from the least significant byte, filling one node at a time:
+	const uint8_t* currentByte = buffer + n;
+	while (currentByte != buffer) {
+		uint64_t data = 0;
+		uint32_t j = 0;
+		while (j < INT_SIZE && currentByte != buffer) {
+			data += (uint64_t) *(--currentByte) << j;
+			j += 8;
+		}
+		struct intNode* newNode = nodeMake(X);
+		newNode->data = data;
+		X->last->next = newNode;
+		X->last = newNode;
+		X->size++;
+		if (data != 0) {
+			lastNonZeroNode = newNode;
+		}
+	}
+	X->size -= nodeFree(X, lastNonZeroNode->next);
+	X->last = lastNonZeroNode;
+	lastNonZeroNode->next = &rootZero;
+	return X;
+} // O(n)
+
+// Given an intChain X, write it into a buffer as exactly n big-endian bytes:
+//  Returns 0 on success, or 1 if X is too large to fit in n bytes.
+uint32_t intToBytes(
+    const struct intChain* X,	// intChain to be written
+    uint8_t* buffer,	// buffer of at least n bytes
+    uint64_t n			// number of bytes to write
+) {
+	assert(!intCheck(X));
+	assert(buffer || n == 0);
+	if (X->size > (n + INT_SIZE / 8 - 1) / (INT_SIZE / 8)) {
+		return 1;
+	}
+	if (X->size * (INT_SIZE / 8) > n && (X->last->data >> 8 * (n % (INT_SIZE / 8)))) {
+		// The top node spills over the front of the buffer.
+		return 1;
+	}
+	struct intNode* currentNode = X->next;
+	uint8_t* currentByte = buffer + n;
+	while (currentByte != buffer) {
+		// Past the end of X, currentNode sits on rootZero and pads the front with zeroes:
+		uint64_t data = currentNode->data;
+		uint32_t j = INT_SIZE / 8;
+		while (j-- && currentByte != buffer) {
+			*(--currentByte) = (uint8_t) data;
+			data >>= 8;
+		}
+		currentNode = currentNode->next;
+	}
+	return 0;
+} // O(n)
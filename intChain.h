@@ -1,12 +1,68 @@
 #pragma once
 #include <stdint.h>
+#include <stdio.h>
 
 // intChain.h
 // Emory Hufbauer, 2016
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Structure for heads of intChains:
+//  Operands passed as const are never modified, not even temporarily, so one intChain can be read by many threads at once.
 struct intChain;
 
+// Free the nodes held in the calling thread's recycling pool:
+//  Runs automatically at exit for the main thread; other threads should call it before they finish.
+void intClearPool(
+    void
+); // O(1)
+
+// Primitives counted by the operation counters:
+enum intStatsOp {
+	INT_STATS_ADD,
+	INT_STATS_SUB,
+	INT_STATS_SCALE,
+	INT_STATS_MULT,
+	INT_STATS_MOD,
+	INT_STATS_DIV,
+	INT_STATS_MODEXP,
+	INT_STATS_MODEXP_TABLE,
+	INT_STATS_ISPRIME,
+	INT_STATS_MAKEPRIME,
+	INT_STATS_OPS
+};
+
+// Operation counters and allocation telemetry:
+//  Only gathered when intChain.c is built with INTCHAIN_STATS; otherwise enabled is 0 and every count stays zero.
+//  Calls made inside other primitives count too, so intMult's intScale and intAdd calls show up under theirs.
+struct intStats {
+	uint32_t enabled;
+	uint64_t calls[INT_STATS_OPS];
+	uint64_t limbs[INT_STATS_OPS];  // limbs of the operands passed in
+	uint64_t modIterations;         // shift-and-subtract steps in intMod and intDiv
+	uint64_t poolHits;              // nodes taken from the recycling pool
+	uint64_t poolMisses;            // nodes that had to be allocated
+	uint64_t inlineNodes;           // nodes taken from their head's inline storage
+	uint64_t shares;                // intChains handed out by intShare without copying
+	uint64_t unshares;              // shared nodes copied because their holder was modified
+	uint64_t mallocs;
+	uint64_t frees;
+	uint64_t getrandomCalls;
+};
+
+// Sum the counters of every thread that has used intChain so far:
+void intReadStats(
+    struct intStats* stats  // receives the totals
+);
+
+// Write the counters in readable form:
+//  Every program using intChain also does this to stderr at exit when the INTCHAIN_STATS environment variable is set.
+void intWriteStats(
+    FILE* out   // stream to write to
+);
+
 // Free the dynamically allocated data in an intChain:
 void intFree(
     struct intChain* X  // intChain to be freed
@@ -17,9 +73,38 @@ struct intChain* intMake(
     void
 ); // O(1)
 
+// Storage for an intChain on the stack or inside another structure, rather than allocated by intMake:
+struct intChainStorage {
+	uint64_t opaque[9];
+};
+
+// Make a new intChain with value zero in caller-provided storage:
+//  Release it with intRelease, never intFree. Values of up to two limbs then never touch the heap.
+struct intChain* intInit(
+    struct intChainStorage* storage // storage to hold the intChain
+); // O(1)
+
+// Free the nodes of an intChain made by intInit, leaving its storage to the caller:
+void intRelease(
+    struct intChain* X  // intChain to be released
+); // O(|X|)
+
+// Let the nodes of an intChain be shared by intShare instead of copied:
+//  Meant for long-lived values such as key material. Call it before X is shared between threads; X stays modifiable,
+//  and modifying any holder of shared nodes first gives it a copy of its own.
+void intShareable(
+    struct intChain* X  // intChain to be made shareable
+); // O(|X|)
+
+// Return a new intChain equal to X, sharing its nodes by reference counting if X is shareable, or copying them if not:
+//  Free the result with intFree as usual.
+struct intChain* intShare(
+    const struct intChain* X  // intChain to be shared
+); // O(1) if X is shareable, O(|X|) if not
+
 // Create a new intChain which is a copy of the given intChain:
 struct intChain* intCopy(
-    struct intChain* X  // intChain to be copied
+    const struct intChain* X  // intChain to be copied
 ); // O(|X|)
 
 // Rightshift an intChain:
@@ -38,32 +123,32 @@ void intLShift(
 
 // Given two intChains, X and Y, return a heuristic approximation to log(X/Y):
 int64_t __attribute__((pure)) intCompare(
-    struct intChain* X, // intChain to be compared
-    struct intChain* Y  // intChain to be compared to
+    const struct intChain* X, // intChain to be compared
+    const struct intChain* Y  // intChain to be compared to
 ); // O(1)
 
 // Given an intChain, X, return a heuristic approximation to log(X):
 int64_t __attribute__((pure)) intMagnitude(
-    struct intChain* X  // intChain whose size to estimate
+    const struct intChain* X  // intChain whose size to estimate
 ); // O(1)
 
 // Given two intChains, X and Y, return 0 if they are equal, 1 if X is greater, and 2 else:
 //  Doesn't give false positives, but slow if the arguments are equal or nearly equal.
 uint32_t __attribute__((pure)) intFineCompare(
-    struct intChain* X, // intChain to be compared
-    struct intChain* Y  // intChain to be compared to
+    const struct intChain* X, // intChain to be compared
+    const struct intChain* Y  // intChain to be compared to
 ); // O(|X|)
 
 // Given two intChains, X and Y, perform X += Y:
 void intAdd(
-    struct intChain* X, // intChain to be added to
-    struct intChain* Y  // intChain to be added
+    struct intChain* X,       // intChain to be added to
+    const struct intChain* Y  // intChain to be added
 ); // O(|X|+|Y|)
 
 // Given two intChains, X and Y, perform X -= Y:
 void intSub(
-    struct intChain* X, // intChain to be subtracted from
-    struct intChain* Y  // intChain to be subtracted
+    struct intChain* X,       // intChain to be subtracted from
+    const struct intChain* Y  // intChain to be subtracted
 ); // O(|X|+|Y|)
 
 // Add one to the given intChain:
@@ -78,19 +163,19 @@ void intDecrement(
 
 // Check if the given intChain is even:
 uint32_t intIsEven(
-    struct intChain* X  // intChain to check the parity of
+    const struct intChain* X  // intChain to check the parity of
 ); // O(1)
 
 // Given two intChains X and Y, reduce X mod Y (much faster than full division):
 void intMod(
-    struct intChain* X, // intChain to reduce
-    struct intChain* Y  // intChain to reduce by
+    struct intChain* X,       // intChain to reduce
+    const struct intChain* Y  // intChain to reduce by
 ); // O(|X|/|Y|)
 
 // Given two intChains X and Y, reduce X mod Y and return a new intChain containing their quotient:
 struct intChain* intDiv(
-    struct intChain* X, // intChain to reduce
-    struct intChain* Y  // intChain to divide by
+    struct intChain* X,       // intChain to reduce
+    const struct intChain* Y  // intChain to divide by
 ); // O(|X|/|Y|)
 
 // Multiply an intChain by a single integer in place:
@@ -101,31 +186,140 @@ void intScale(
 
 // Return a new intChain containing the product of X and Y:
 struct intChain* intMult(
-    struct intChain* X, // first intChain to be multiplied
-    struct intChain* Y  // second intChain to be multiplied
+    const struct intChain* X, // first intChain to be multiplied
+    const struct intChain* Y  // second intChain to be multiplied
 ); // O(|X|*|Y|)
 
 struct intChain* intModExp(
-    struct intChain* X, // base
-    struct intChain* Y, // exponent
-    struct intChain* Z  // modulus
+    const struct intChain* X, // base
+    const struct intChain* Y, // exponent
+    const struct intChain* Z  // modulus
 );
 
+// Given a table of X^(2^i) mod Z for i = 0, 1, 2..., return X^Y mod Z:
+//  Each entry is stored as limbs little-endian 64-bit limbs, and the table needs an entry for every bit of Y.
+struct intChain* intModExpTable(
+    const uint8_t* table,     // precomputed powers of the base
+    uint64_t limbs,           // limbs per table entry
+    uint64_t entries,         // number of entries in the table
+    const struct intChain* Y, // exponent
+    const struct intChain* Z  // modulus
+);
+
+// Precomputed Montgomery constants for one odd modulus:
+//  Read-only once made, so one set can serve many threads at once.
+struct intModulus;
+
+// Given an odd modulus Z, precompute its Montgomery constants:
+//  Returns 0 if Z is even. 2048-, 3072- and 4096-bit moduli get fully specialized arithmetic. A pseudo-Mersenne
+//  modulus, 2^(64n) - c with c below 2^32, reduces by folding the high half onto the low half instead.
+struct intModulus* intModulusMake(
+    const struct intChain* Z  // modulus
+); // O(|Z|^2)
+
+// Free the constants made by intModulusMake:
+void intModulusFree(
+    struct intModulus* M  // constants to be freed
+); // O(1)
+
+// Return the bytes held by a set of constants, including their copy of the modulus:
+uint64_t intModulusBytes(
+    const struct intModulus* M  // constants of the modulus
+); // O(1)
+
+// Return the modulus a set of constants was made for:
+const struct intChain* intModulusValue(
+    const struct intModulus* M  // constants of the modulus
+); // O(1)
+
+// Return c if the modulus is pseudo-Mersenne, 2^bits - c, storing bits; or return 0 if it reduces by Montgomery:
+uint64_t intModulusOffset(
+    const struct intModulus* M, // constants of the modulus
+    uint64_t* bits              // receives the power of two; may be 0
+); // O(1)
+
+// Given X and Y, return X * Y mod M without forming the full product:
+struct intChain* intModulusMult(
+    const struct intChain* X,   // first factor
+    const struct intChain* Y,   // second factor
+    const struct intModulus* M  // constants of the modulus
+); // O(|M|^2)
+
+// Given X and Y, return X^Y mod M:
+struct intChain* intModulusExp(
+    const struct intChain* X,   // base
+    const struct intChain* Y,   // exponent
+    const struct intModulus* M  // constants of the modulus
+); // O(|Y| |M|^2)
+
+// Given a table of X^(2^i) mod M as for intModExpTable, return X^Y mod M:
+//  One multiplication per set bit of Y and no squarings, besides a few to cancel the Montgomery factors.
+struct intChain* intModulusExpTable(
+    const uint8_t* table,       // precomputed powers of the base
+    uint64_t limbs,             // limbs per table entry, at least the limbs of the modulus
+    uint64_t entries,           // number of entries in the table
+    const struct intChain* Y,   // exponent
+    const struct intModulus* M  // constants of the modulus
+); // O(|Y| |M|^2)
+
+// Given X, return X^-1 mod M, for a prime modulus:
+//  Returns zero if X is a multiple of the modulus.
+struct intChain* intModulusInverse(
+    const struct intChain* X,   // value to invert
+    const struct intModulus* M  // constants of a prime modulus
+); // O(|M|^3)
+
+// Replace each of X[0..count) with its inverse mod M, for a prime modulus:
+//  Costs one inversion and about three multiplications per value, rather than one inversion per value.
+//  Multiples of the modulus become zero without affecting the rest of the batch.
+void intModulusBatchInverse(
+    struct intChain** X,        // values to invert, each freed and replaced by a new intChain
+    uint64_t count,             // number of values
+    const struct intModulus* M  // constants of a prime modulus
+); // O(count |M|^2 + |M|^3)
+
+// A sliding-window schedule for one fixed exponent:
+//  Read-only once made, so one plan can serve many threads at once.
+struct intExponentPlan;
+
+// Given a fixed exponent Y, compute its sliding-window schedule once, choosing the window width for Y:
+struct intExponentPlan* intExponentPlanMake(
+    const struct intChain* Y  // exponent
+); // O(|Y|)
+
+// Free a plan made by intExponentPlanMake:
+void intExponentPlanFree(
+    struct intExponentPlan* plan  // plan to be freed
+); // O(1)
+
+// Return the bytes held by a plan:
+uint64_t intExponentPlanBytes(
+    const struct intExponentPlan* plan  // plan to measure
+); // O(1)
+
+// Given X and a planned exponent Y, return X^Y mod M:
+//  Runs the schedule without scanning Y again, using a table of odd powers of X.
+struct intChain* intModulusExpPlan(
+    const struct intChain* X,           // base
+    const struct intExponentPlan* plan, // schedule of the exponent
+    const struct intModulus* M          // constants of the modulus
+); // O(|Y| |M|^2)
+
 // Generate an intChain between zero and X filled with high quality random data:
 struct intChain* intCryptoRandom(
-    struct intChain* X  // Upper bound for random value
+    const struct intChain* X  // Upper bound for random value
 ); // Probabilistically O(|X|)
 
 // Generate an intChain between zero and X filled with low quality random data:
 //  Faster and less taxing on system resources.
 struct intChain* intPseudoRandom(
-    struct intChain* X  // Upper bound for random value
+    const struct intChain* X  // Upper bound for random value
 ); // Probabilistically O(|X|)
 
 // Test whether a given intChain is prime, to confidence 1 - 4^(-security):
 //  Uses the Miller-Rabin algorithm.
 uint32_t intIsPrime(
-    struct intChain* X  // order of magnitude for prime to be generated
+    const struct intChain* X  // order of magnitude for prime to be generated
 );
 
 // Find and return a prime p such that 2^size < p < 2^(size+1):
@@ -133,26 +327,100 @@ struct intChain* intMakePrime(
     uint64_t size       // order of magnitude for prime to be generated
 );
 
+// Find and return the largest safe prime p = 2^size - c with c below 2^32, storing c to offset:
+//  size must be a multiple of 64, and (p - 1) / 2 is prime too. Such moduli are recognized by intModulusMake and
+//  intModExp, which reduce by folding instead of Montgomery multiplication. Returns 0 if there is none.
+struct intChain* intMakePseudoMersennePrime(
+    uint64_t size,      // bits in the prime, a multiple of 64
+    uint64_t* offset    // receives c, or 0 if there is none
+);
+
+// Find and return a generator mod a prime P, given every prime factor of P - 1:
+//  Securely random; checks that G^((P - 1) / f) isn't 1 for any of the factors.
+struct intChain* intFindGenerator(
+    const struct intChain* P,           // prime to find a generator of
+    const struct intChain** Factors,    // distinct prime factors of P - 1
+    uint64_t factorCount                // number of factors
+);
+
 // Find and return a primitive root mod a prime P:
-//  Securely random.
+//  Securely random. Only the factor 2 of P - 1 is checked; use intFindGenerator when the others are known.
 struct intChain* intFindPrimitiveRoot(
-    struct intChain* P  // Prime to find a primitive root of
+    const struct intChain* P  // Prime to find a primitive root of
 );
 
 struct intChain* intEncodeString(
-    char* buffer
+    const char* buffer
 );
 
 char* intDecodeString(
-    struct intChain* X
+    const struct intChain* X
 );
 
+// Return the number of bytes intWriteString needs to write X, including the terminating NUL:
+uint64_t intStringLength(
+    const struct intChain* X  // intChain to be measured
+); // O(1)
+
+// Given an intChain X, write it into a caller-supplied buffer as a big-endian string:
+//  The buffer must hold at least intStringLength(X) bytes; returns the buffer.
+char* intWriteString(
+    const struct intChain* X, // intChain to be converted to a string
+    char* buffer              // buffer to write into
+); // O(|X|)
+
 // Given an intChain X, convert it to a big-endian string:
 char* intToString(
-    struct intChain* X  // intChain to be converted to a string
+    const struct intChain* X  // intChain to be converted to a string
 ); // O(|X|)
 
+// Given a buffer of hex digits, allocate an intChain holding the represented integer:
+//  Needs no terminating NUL; anything other than a hex digit is skipped.
+struct intChain* intFromHex(
+    const char* buffer, // buffer containing the digits
+    uint64_t length     // number of characters in the buffer
+); // O(|buf|)
+
 // Given a hex-string representing an integer, allocate an intChain capable of holding the represented integer, and fill it with the given data:
 struct intChain* intFromString(
-    char* buffer        // buffer containing the string to be converted to an intChain
+    const char* buffer        // buffer containing the string to be converted to an intChain
 ); // O(|buf| + |X|)
+
+// Given an intChain X, write it into a buffer as exactly n little-endian 64-bit limbs:
+//  Returns 0 on success, or 1 if X is too large to fit in n limbs.
+uint32_t intToLimbs(
+    const struct intChain* X, // intChain to be written
+    uint8_t* buffer,          // buffer of at least 8 * n bytes
+    uint64_t n                // number of limbs to write
+); // O(n)
+
+// Given a buffer of n little-endian 64-bit limbs, allocate an intChain holding the represented integer:
+struct intChain* intFromLimbs(
+    const uint8_t* buffer, // buffer of at least 8 * n bytes
+    uint64_t n             // number of limbs to read
+); // O(n)
+
+// Given an intChain X and a seed, return a 64-bit FNV-1a hash of X's limbs:
+//  Chain calls through the seed to fingerprint several intChains together.
+uint64_t __attribute__((pure)) intHash(
+    const struct intChain* X, // intChain to be hashed
+    uint64_t seed             // previous hash value, or zero to start fresh
+); // O(|X|)
+
+// Given a buffer of n bytes holding a big-endian integer, allocate an intChain holding the represented integer:
+struct intChain* intFromBytes(
+    const uint8_t* buffer, // buffer of at least n bytes
+    uint64_t n             // number of bytes to read
+); // O(n)
+
+// Given an intChain X, write it into a buffer as exactly n big-endian bytes:
+//  Returns 0 on success, or 1 if X is too large to fit in n bytes.
+uint32_t intToBytes(
+    const struct intChain* X, // intChain to be written
+    uint8_t* buffer,          // buffer of at least n bytes
+    uint64_t n                // number of bytes to write
+); // O(n)
+
+#ifdef __cplusplus
+}
+#endif
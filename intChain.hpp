@@ -0,0 +1,391 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "intChain.h"
+
+// intChain.hpp
+// Header-only C++ wrapper over intChain: values that free themselves, move cheaply and copy by sharing,
+//  and expression templates so that a * b % M, with M a Modulus, and pow(g, r, p) each become one call into intChain.
+//  Only a Modulus skips the full product: a * b % p with a BigInt p is still intMult and then intMod.
+//  Every result is a new intChain, allocated by the C interface.
+
+namespace elgamal {
+
+// An intChain owned by value:
+//  Copies are shares (intShare), so copying a shareable value costs nothing until one side is modified.
+//  A moved-from BigInt holds nothing and may only be assigned to or destroyed.
+class BigInt {
+public:
+	BigInt() : chain(intMake()) {}
+
+	explicit BigInt(uint64_t value) : chain(fromWord(value)) {}
+
+	// Parse hex digits, as written by toString or stored in key files:
+	explicit BigInt(const std::string& hex) : chain(intFromHex(hex.data(), hex.size())) {}
+
+	BigInt(const BigInt& other) : chain(intShare(other.chain)) {}
+
+	BigInt(BigInt&& other) noexcept : chain(other.chain) {
+		other.chain = nullptr;
+	}
+
+	BigInt& operator=(const BigInt& other) {
+		if (this != &other) {
+			reset(intShare(other.chain));
+		}
+		return *this;
+	}
+
+	BigInt& operator=(BigInt&& other) noexcept {
+		std::swap(chain, other.chain);
+		return *this;
+	}
+
+	~BigInt() {
+		if (chain) {
+			intFree(chain);
+		}
+	}
+
+	// Take ownership of an intChain returned by the C interface:
+	static BigInt adopt(struct intChain* X) {
+		return BigInt(X, Adopt());
+	}
+
+	// Give up ownership of the intChain, which the caller must intFree:
+	struct intChain* release() {
+		struct intChain* X = chain;
+		chain = nullptr;
+		return X;
+	}
+
+	struct intChain* get() {
+		return chain;
+	}
+
+	const struct intChain* get() const {
+		return chain;
+	}
+
+	// Let copies of this value share its nodes (see intShareable):
+	void shareable() {
+		intShareable(chain);
+	}
+
+	std::string toString() const {
+		char* text = intToString(chain);
+		std::string result(text);
+		free(text);
+		return result;
+	}
+
+	bool isEven() const {
+		return intIsEven(chain);
+	}
+
+	BigInt& operator+=(const BigInt& Y) {
+		intAdd(chain, Y.chain);
+		return *this;
+	}
+
+	// Requires *this >= Y:
+	BigInt& operator-=(const BigInt& Y) {
+		intSub(chain, Y.chain);
+		return *this;
+	}
+
+	BigInt& operator*=(const BigInt& Y) {
+		reset(intMult(chain, Y.chain));
+		return *this;
+	}
+
+	BigInt& operator*=(uint64_t scalar) {
+		intScale(chain, scalar);
+		return *this;
+	}
+
+	BigInt& operator%=(const BigInt& Y) {
+		intMod(chain, Y.chain);
+		return *this;
+	}
+
+	BigInt& operator/=(const BigInt& Y) {
+		reset(intDiv(chain, Y.chain));
+		return *this;
+	}
+
+	BigInt& operator<<=(uint64_t n) {
+		intLShift(chain, n);
+		return *this;
+	}
+
+	BigInt& operator>>=(uint64_t n) {
+		intRShift(chain, n);
+		return *this;
+	}
+
+	BigInt& operator++() {
+		intIncrement(chain);
+		return *this;
+	}
+
+	// Requires *this > 0:
+	BigInt& operator--() {
+		intDecrement(chain);
+		return *this;
+	}
+
+	friend bool operator==(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) == 0;
+	}
+
+	friend bool operator!=(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) != 0;
+	}
+
+	friend bool operator<(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) == 2;
+	}
+
+	friend bool operator>(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) == 1;
+	}
+
+	friend bool operator<=(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) != 1;
+	}
+
+	friend bool operator>=(const BigInt& X, const BigInt& Y) {
+		return intFineCompare(X.chain, Y.chain) != 2;
+	}
+
+private:
+	struct Adopt {};
+
+	BigInt(struct intChain* X, Adopt) : chain(X) {}
+
+	static struct intChain* fromWord(uint64_t value) {
+		uint8_t limb[8];
+		for (uint32_t j = 0; j < 8; j++) {
+			limb[j] = (uint8_t) (value >> 8 * j);
+		}
+		return intFromLimbs(limb, 1);
+	}
+
+	void reset(struct intChain* X) {
+		if (chain) {
+			intFree(chain);
+		}
+		chain = X;
+	}
+
+	struct intChain* chain;
+};
+
+inline BigInt operator+(BigInt X, const BigInt& Y) {
+	X += Y;
+	return X;
+}
+
+inline BigInt operator-(BigInt X, const BigInt& Y) {
+	X -= Y;
+	return X;
+}
+
+inline BigInt operator%(BigInt X, const BigInt& Y) {
+	X %= Y;
+	return X;
+}
+
+inline BigInt operator/(BigInt X, const BigInt& Y) {
+	X /= Y;
+	return X;
+}
+
+inline BigInt operator<<(BigInt X, uint64_t n) {
+	X <<= n;
+	return X;
+}
+
+inline BigInt operator>>(BigInt X, uint64_t n) {
+	X >>= n;
+	return X;
+}
+
+// Precomputed Montgomery constants for an odd modulus (see intModulusMake):
+//  Reducing by a Modulus rather than a BigInt takes the Montgomery path. Read-only once made, so it can be shared
+//  between threads; it can't be copied, only moved.
+class Modulus {
+public:
+	explicit Modulus(const BigInt& Z) : constants(intModulusMake(Z.get())) {
+		if (!constants) {
+			throw std::invalid_argument("Montgomery moduli must be odd");
+		}
+	}
+
+	Modulus(const Modulus&) = delete;
+	Modulus& operator=(const Modulus&) = delete;
+
+	Modulus(Modulus&& other) noexcept : constants(other.constants) {
+		other.constants = nullptr;
+	}
+
+	Modulus& operator=(Modulus&& other) noexcept {
+		std::swap(constants, other.constants);
+		return *this;
+	}
+
+	~Modulus() {
+		if (constants) {
+			intModulusFree(constants);
+		}
+	}
+
+	const struct intModulus* get() const {
+		return constants;
+	}
+
+	BigInt value() const {
+		return BigInt::adopt(intShare(intModulusValue(constants)));
+	}
+
+private:
+	struct intModulus* constants;
+};
+
+// A product not yet evaluated:
+//  Holds references to its operands, so it must be used within the full expression that made it; assign it to a
+//  BigInt to keep it. Reducing it by a BigInt forms the full product with intMult and reduces it in place with intMod,
+//  the two-step path; reducing it by a Modulus never forms the full product at all. Either way the result is a newly
+//  allocated BigInt.
+template <class Left, class Right>
+class Product {
+public:
+	Product(const Left& X, const Right& Y) : left(X), right(Y) {}
+
+	operator BigInt() const {
+		return BigInt::adopt(intMult(evaluate(left).get(), evaluate(right).get()));
+	}
+
+	BigInt operator%(const BigInt& Z) const {
+		BigInt result = *this;
+		result %= Z;
+		return result;
+	}
+
+	BigInt operator%(const Modulus& M) const {
+		return BigInt::adopt(intModulusMult(reduce(left, M).get(), reduce(right, M).get(), M.get()));
+	}
+
+private:
+	const Left& left;
+	const Right& right;
+
+	static const BigInt& evaluate(const BigInt& X) {
+		return X;
+	}
+
+	template <class L, class R>
+	static BigInt evaluate(const Product<L, R>& X) {
+		return X;
+	}
+
+	// intModulusMult reduces its operands itself, so only nested products need work here:
+	static const BigInt& reduce(const BigInt& X, const Modulus&) {
+		return X;
+	}
+
+	template <class L, class R>
+	static BigInt reduce(const Product<L, R>& X, const Modulus& M) {
+		return X % M;
+	}
+};
+
+inline Product<BigInt, BigInt> operator*(const BigInt& X, const BigInt& Y) {
+	return Product<BigInt, BigInt>(X, Y);
+}
+
+template <class L, class R>
+Product<Product<L, R>, BigInt> operator*(const Product<L, R>& X, const BigInt& Y) {
+	return Product<Product<L, R>, BigInt>(X, Y);
+}
+
+template <class L, class R>
+Product<BigInt, Product<L, R>> operator*(const BigInt& X, const Product<L, R>& Y) {
+	return Product<BigInt, Product<L, R>>(X, Y);
+}
+
+// X^Y mod Z; the fixed-width widths take the Montgomery path automatically:
+inline BigInt pow(const BigInt& X, const BigInt& Y, const BigInt& Z) {
+	return BigInt::adopt(intModExp(X.get(), Y.get(), Z.get()));
+}
+
+// X^Y mod M, reusing M's constants:
+inline BigInt pow(const BigInt& X, const BigInt& Y, const Modulus& M) {
+	return BigInt::adopt(intModulusExp(X.get(), Y.get(), M.get()));
+}
+
+// A residue tied to a Modulus, whose arithmetic always stays reduced:
+//  The Modulus must outlive every ModInt made with it.
+class ModInt {
+public:
+	ModInt(const BigInt& X, const Modulus& M) : modulus(&M), value(X % M.value()) {}
+
+	const BigInt& get() const {
+		return value;
+	}
+
+	const Modulus& mod() const {
+		return *modulus;
+	}
+
+	ModInt& operator*=(const ModInt& Y) {
+		value = BigInt::adopt(intModulusMult(value.get(), Y.value.get(), modulus->get()));
+		return *this;
+	}
+
+	ModInt& operator+=(const ModInt& Y) {
+		value += Y.value;
+		BigInt Z = modulus->value();
+		if (value >= Z) {
+			value -= Z;
+		}
+		return *this;
+	}
+
+	ModInt pow(const BigInt& Y) const {
+		return ModInt(BigInt::adopt(intModulusExp(value.get(), Y.get(), modulus->get())), *modulus, Reduced());
+	}
+
+	friend ModInt operator*(ModInt X, const ModInt& Y) {
+		X *= Y;
+		return X;
+	}
+
+	friend ModInt operator+(ModInt X, const ModInt& Y) {
+		X += Y;
+		return X;
+	}
+
+	friend bool operator==(const ModInt& X, const ModInt& Y) {
+		return X.value == Y.value;
+	}
+
+	friend bool operator!=(const ModInt& X, const ModInt& Y) {
+		return X.value != Y.value;
+	}
+
+private:
+	struct Reduced {};
+
+	ModInt(BigInt&& X, const Modulus& M, Reduced) : modulus(&M), value(std::move(X)) {}
+
+	const Modulus* modulus;
+	BigInt value;
+};
+
+} // namespace elgamal
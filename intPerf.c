@@ -16,5 +16,25 @@ int main(int argc, char *argv[]) {
 	intFree(Y);
 	intFree(Z);
 	intFree(W);
+	// Train the fixed-width exponentiations too, with odd moduli of each standard size:
+	uint64_t sizes[] = {2048, 3072, 4096};
+	uint32_t k;
+	for (k = 0; k < 3; k++) {
+		intFree(Size);
+		Size = intMake();
+		intIncrement(Size);
+		intLShift(Size, sizes[k] - 1);
+		X = intPseudoRandom(Size);
+		Y = intPseudoRandom(Size);
+		Z = intPseudoRandom(Size);
+		intLShift(Z, 1);
+		intIncrement(Z);
+		W = intModExp(X, Y, Z);
+		intFree(X);
+		intFree(Y);
+		intFree(Z);
+		intFree(W);
+	}
+	intFree(Size);
 	return 0;
 }
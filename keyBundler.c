@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "intChain.h"
+#include "keyFile.h"
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		printf("Usage: %s keyFile bundleFile\n", argv[0]);
+		return 1;
+	}
+	// Read a public or private key, in either format:
+	struct keyFile key;
+	uint32_t status = keyLoad(&key, argv[1]);
+	if (status == 1) {
+		printf("Couldn't open keyFile.");
+		return 2;
+	} else if (status) {
+		printf("The key file is improperly formatted.\n");
+		return 3;
+	}
+	// Write it back out with its precomputed data:
+	if (keyWriteBundle(&key, argv[2])) {
+		printf("Failed to write the key bundle.\n");
+		return 4;
+	}
+	keyRelease(&key);
+	return 0;
+}
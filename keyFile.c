@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "keyFile.h"
+#include "trace.h"
+
+// keyFile.c
+// Loading of text keys and binary key bundles.
+
+// Store an integer as n little-endian bytes:
+static void putLittle(
+    uint8_t* buffer,
+    uint64_t value,
+    uint32_t n
+) {
+	while (n--) {
+		*(buffer++) = (uint8_t) value;
+		value >>= 8;
+	}
+}
+
+// Load an integer from n little-endian bytes:
+static uint64_t getLittle(
+    const uint8_t* buffer,
+    uint32_t n
+) {
+	uint64_t value = 0;
+	while (n--) {
+		value <<= 8;
+		value += buffer[n];
+	}
+	return value;
+}
+
+// Return the id of a public key, as recorded in ciphertext headers:
+uint64_t keyFingerprint(
+    struct intChain* PrimeModulus,
+    struct intChain* Generator,
+    struct intChain* Exponential
+) {
+	uint64_t hash = intHash(PrimeModulus, 0);
+	hash = intHash(Generator, hash);
+	return intHash(Exponential, hash);
+} // O(|PrimeModulus|)
+
+// Mark a key's numbers shareable, whichever format they came from:
+//  Key material lives as long as the key, so intModExp shares it rather than copying it.
+static void keyShare(
+    struct keyFile* key
+) {
+	struct intChain* numbers[] = {
+		key->PrimeModulus, key->Generator, key->Exponential, key->Exponent, key->DecryptionExponent
+	};
+	uint32_t j;
+	for (j = 0; j < sizeof numbers / sizeof * numbers; j++) {
+		if (numbers[j]) {
+			intShareable(numbers[j]);
+		}
+	}
+}
+
+// Fill in the values every key derives from its numbers:
+static void keyDerive(
+    struct keyFile* key
+) {
+	key->limbs = (key->keySize + 63) / 64;
+	if (key->kind == KEY_PRIVATE) {
+		if (!key->Exponential) {
+			key->Exponential = intModExp(key->Generator, key->Exponent, key->PrimeModulus);
+		}
+		if (!key->DecryptionExponent) {
+			// Cipher^(PrimeModulus - 1 - Exponent) is the inverse of Cipher^Exponent, by Fermat's little theorem:
+			key->DecryptionExponent = intCopy(key->PrimeModulus);
+			intDecrement(key->DecryptionExponent);
+			intSub(key->DecryptionExponent, key->Exponent);
+		}
+	}
+	key->keyId = keyFingerprint(key->PrimeModulus, key->Generator, key->Exponential);
+	keyShare(key);
+}
+
+// Check that a key's numbers are usable with its key size, whichever format they came from:
+//  Returns 0 if they are, or 2 if the key is improperly formatted.
+static uint32_t keyCheck(
+    struct keyFile* key
+) {
+	if (!key->PrimeModulus || !key->Generator || !(key->Exponential || key->Exponent)) {
+		return 2;
+	}
+	// A prime modulus is odd and above one; anything else can't be reduced by, nor keep a message secret:
+	if (intIsEven(key->PrimeModulus)) {
+		return 2;
+	}
+	struct intChain* One = intMake();
+	intIncrement(One);
+	uint32_t isOne = intFineCompare(key->PrimeModulus, One) == 0;
+	intFree(One);
+	if (isOne) {
+		return 2;
+	}
+	// Every number has to fit in the limbs the key size allows:
+	int64_t magnitude = intMagnitude(key->PrimeModulus);
+	if (magnitude < 1 || magnitude >= (int64_t) key->keySize) {
+		return 2;
+	}
+	return 0;
+}
+
+// Find a labelled number in a text key and parse it:
+static struct intChain* textField(
+    const char* text,
+    const char* label
+) {
+	const char* field = strstr(text, label);
+	if (!field) {
+		return 0;
+	}
+	field += strlen(label);
+	return intFromHex(field, strcspn(field, "\n"));
+}
+
+// Parse a key in the text format written by keyGenerator:
+static uint32_t keyParseText(
+    struct keyFile* key,
+    const char* text
+) {
+	const char* sizeText;
+	if (strncmp(text, "Public Key (", 12) == 0) {
+		key->kind = KEY_PUBLIC;
+		sizeText = text + 12;
+	} else if (strncmp(text, "Private Key (", 13) == 0) {
+		key->kind = KEY_PRIVATE;
+		sizeText = text + 13;
+	} else {
+		return 2;
+	}
+	char* sizeEnd;
+	key->keySize = strtoull(sizeText, &sizeEnd, 10);
+	if (sizeEnd == sizeText || key->keySize == 0) {
+		return 2;
+	}
+	key->PrimeModulus = textField(text, "\nPrimeModulus:");
+	key->Generator = textField(text, "\nGenerator:");
+	if (key->kind == KEY_PUBLIC) {
+		key->Exponential = textField(text, "\nExponential:");
+	} else {
+		key->Exponent = textField(text, "\nExponent:");
+	}
+	if (keyCheck(key)) {
+		return 2;
+	}
+	keyDerive(key);
+	return 0;
+}
+
+// Adopt a mapped key bundle:
+static uint32_t keyParseBundle(
+    struct keyFile* key
+) {
+	const uint8_t* data = key->data;
+	if (getLittle(data + 4, 2) != KEY_VERSION) {
+		return 2;
+	}
+	key->kind = getLittle(data + 6, 2);
+	key->keySize = getLittle(data + 8, 4);
+	uint64_t limbs = getLittle(data + 12, 4);
+	key->tableEntries = getLittle(data + 16, 4);
+	key->keyId = getLittle(data + 24, 8);
+	if (limbs != (key->keySize + 63) / 64 || limbs == 0) {
+		return 2;
+	}
+	uint64_t recordSize = 8 * limbs;
+	uint64_t expected = KEY_HEADER_SIZE + 3 * recordSize;
+	if (key->kind == KEY_PRIVATE) {
+		expected += 2 * recordSize;
+	} else if (key->kind == KEY_PUBLIC) {
+		expected += 2 * key->tableEntries * recordSize;
+	} else {
+		return 2;
+	}
+	if (key->length != expected) {
+		return 2;
+	}
+	const uint8_t* record = data + KEY_HEADER_SIZE;
+	key->PrimeModulus = intFromLimbs(record, limbs);
+	key->Generator = intFromLimbs(record + recordSize, limbs);
+	key->Exponential = intFromLimbs(record + 2 * recordSize, limbs);
+	record += 3 * recordSize;
+	if (key->kind == KEY_PRIVATE) {
+		key->Exponent = intFromLimbs(record, limbs);
+		key->DecryptionExponent = intFromLimbs(record + recordSize, limbs);
+		key->tableEntries = 0;
+	} else if (key->tableEntries) {
+		key->generatorTable = record;
+		key->exponentialTable = record + key->tableEntries * recordSize;
+	}
+	key->limbs = limbs;
+	// A bundle's numbers get the checks a text key's do, and its id has to be the one they make:
+	if (keyCheck(key) || key->keyId != keyFingerprint(key->PrimeModulus, key->Generator, key->Exponential)) {
+		return 2;
+	}
+	keyShare(key);
+	return 0;
+}
+
+// Map and parse a key file:
+static uint32_t keyLoadFile(
+    struct keyFile* key,
+    const char* path
+) {
+	memset(key, 0, sizeof * key);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return 1;
+	}
+	if (info.st_size == 0) {
+		close(fd);
+		return 2;
+	}
+	void* data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return 1;
+	}
+	key->data = data;
+	key->length = info.st_size;
+	uint32_t status;
+	if (key->length >= KEY_HEADER_SIZE && memcmp(key->data, KEY_MAGIC, 4) == 0) {
+		// Bundles stay mapped, so their tables can be used in place:
+		status = keyParseBundle(key);
+	} else {
+		char* text = malloc(key->length + 1);
+		assert(text);
+		memcpy(text, key->data, key->length);
+		text[key->length] = 0;
+		munmap((void*) key->data, key->length);
+		key->data = 0;
+		key->length = 0;
+		status = keyParseText(key, text);
+		free(text);
+	}
+	if (status) {
+		keyRelease(key);
+	}
+	return status;
+}
+
+// Load a text key or a key bundle, whichever the file holds:
+uint32_t keyLoad(
+    struct keyFile* key,
+    const char* path
+) {
+	uint64_t start = traceBegin();
+	uint32_t status = keyLoadFile(key, path);
+	traceEnd("keyLoad", start, status);
+	return status;
+}
+
+// Write one number as a record of limbs:
+static uint32_t writeRecord(
+    FILE* fp,
+    struct intChain* X,
+    uint8_t* buffer,
+    uint64_t limbs
+) {
+	if (intToLimbs(X, buffer, limbs)) {
+		return 1;
+	}
+	return fwrite(buffer, 8, limbs, fp) != limbs;
+}
+
+// Write the table Base^(2^i) mod PrimeModulus for i below keySize:
+static uint32_t writeTable(
+    FILE* fp,
+    struct keyFile* key,
+    struct intChain* Base,
+    uint8_t* buffer
+) {
+	struct intChain* Power = intCopy(Base);
+	uint32_t status = 0;
+	uint64_t i;
+	for (i = 0; i < key->keySize && !status; i++) {
+		status = writeRecord(fp, Power, buffer, key->limbs);
+		struct intChain* Square = intMult(Power, Power);
+		intMod(Square, key->PrimeModulus);
+		intFree(Power);
+		Power = Square;
+	}
+	intFree(Power);
+	return status;
+}
+
+// Write the bundle file itself:
+static uint32_t keyWriteFile(
+    struct keyFile* key,
+    const char* path
+) {
+	FILE* fp = fopen(path, "wb");
+	if (fp == 0) {
+		return 1;
+	}
+	uint8_t header[KEY_HEADER_SIZE] = {0};
+	memcpy(header, KEY_MAGIC, 4);
+	putLittle(header + 4, KEY_VERSION, 2);
+	putLittle(header + 6, key->kind, 2);
+	putLittle(header + 8, key->keySize, 4);
+	putLittle(header + 12, key->limbs, 4);
+	// Exponents are below PrimeModulus < 2^keySize, so keySize entries cover every exponent:
+	putLittle(header + 16, key->kind == KEY_PUBLIC ? key->keySize : 0, 4);
+	putLittle(header + 24, key->keyId, 8);
+	uint8_t* buffer = malloc(8 * key->limbs);
+	assert(buffer);
+	uint32_t status = fwrite(header, KEY_HEADER_SIZE, 1, fp) != 1;
+	status = status || writeRecord(fp, key->PrimeModulus, buffer, key->limbs);
+	status = status || writeRecord(fp, key->Generator, buffer, key->limbs);
+	status = status || writeRecord(fp, key->Exponential, buffer, key->limbs);
+	if (key->kind == KEY_PRIVATE) {
+		status = status || writeRecord(fp, key->Exponent, buffer, key->limbs);
+		status = status || writeRecord(fp, key->DecryptionExponent, buffer, key->limbs);
+	} else {
+		status = status || writeTable(fp, key, key->Generator, buffer);
+		status = status || writeTable(fp, key, key->Exponential, buffer);
+	}
+	free(buffer);
+	status = fclose(fp) || status;
+	return status;
+}
+
+// Write a loaded key out as a bundle, computing its tables if it is a public key:
+uint32_t keyWriteBundle(
+    struct keyFile* key,
+    const char* path
+) {
+	uint64_t start = traceBegin();
+	uint32_t status = keyWriteFile(key, path);
+	traceEnd("keyWrite", start, status);
+	return status;
+}
+
+// Free a loaded key and unmap its bundle:
+void keyRelease(
+    struct keyFile* key
+) {
+	struct intChain** numbers[] = {
+		&key->PrimeModulus, &key->Generator, &key->Exponential, &key->Exponent, &key->DecryptionExponent
+	};
+	uint32_t j;
+	for (j = 0; j < sizeof numbers / sizeof * numbers; j++) {
+		if (*numbers[j]) {
+			intFree(*numbers[j]);
+		}
+	}
+	if (key->data) {
+		munmap((void*) key->data, key->length);
+	}
+	memset(key, 0, sizeof * key);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+#include "intChain.h"
+
+// keyFile.h
+// Loading of text keys and binary key bundles.
+
+// Key bundle layout (all fields little-endian):
+//  Header, KEY_HEADER_SIZE bytes:
+//   "EGKB", version (16 bits), kind (16 bits), key size in bits (32 bits),
+//   limbs per number (32 bits), table entries (32 bits), reserved (32 bits), key id (64 bits).
+//  Then PrimeModulus, Generator and Exponential, each as exactly "limbs" 64-bit limbs.
+//  Private bundles follow those with Exponent and the decryption exponent PrimeModulus - 1 - Exponent.
+//  Public bundles follow them with two fixed-base tables, Generator^(2^i) and Exponential^(2^i) mod PrimeModulus,
+//   with "table entries" entries of "limbs" limbs each.
+#define KEY_MAGIC "EGKB"
+#define KEY_VERSION 1
+#define KEY_HEADER_SIZE 32
+#define KEY_PUBLIC 1
+#define KEY_PRIVATE 2
+
+// A loaded key:
+//  Exponent and DecryptionExponent are only set for private keys;
+//  the tables are only set for public keys loaded from a bundle, and point into its mapping.
+struct keyFile {
+	uint32_t kind;
+	uint64_t keySize;
+	uint64_t keyId;
+	struct intChain* PrimeModulus;
+	struct intChain* Generator;
+	struct intChain* Exponential;
+	struct intChain* Exponent;
+	struct intChain* DecryptionExponent;
+	uint64_t limbs;
+	uint64_t tableEntries;
+	const uint8_t* generatorTable;
+	const uint8_t* exponentialTable;
+	const uint8_t* data;
+	uint64_t length;
+};
+
+// Return the id of a public key, as recorded in ciphertext headers:
+uint64_t keyFingerprint(
+    struct intChain* PrimeModulus,
+    struct intChain* Generator,
+    struct intChain* Exponential
+); // O(|PrimeModulus|)
+
+// Load a text key or a key bundle, whichever the file holds:
+//  Returns 0 on success, 1 if the file can't be read, or 2 if it is improperly formatted.
+uint32_t keyLoad(
+    struct keyFile* key,    // key to fill in
+    const char* path        // path of the key file
+);
+
+// Write a loaded key out as a bundle, computing its tables if it is a public key:
+//  Returns 0 on success, or 1 if the file can't be written.
+uint32_t keyWriteBundle(
+    struct keyFile* key,    // key to write
+    const char* path        // path of the bundle
+);
+
+// Free a loaded key and unmap its bundle:
+void keyRelease(
+    struct keyFile* key     // key to release
+);
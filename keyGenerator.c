@@ -1,60 +1,311 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "intChain.h"
+#include "keyFile.h"
+#include "trace.h"
 
-int main(int argc, char* argv[]) {
-	if (argc < 4) {
-		printf("Usage: %s keySize privateKeyFile publicKeyFile\n", argv[0]);
-		return 1;
-	}
-	char* strEnd;
-	// Read the user's choice of key size:
-	uint64_t keySize = strtoll(argv[1], &strEnd, 10);
-	// Randomly pick a prime modulus to use:
-	struct intChain* PrimeModulus = intMakePrime(keySize);
-	// Find a random primitive root of the prime modulus to use as a generator:
-	struct intChain* Generator = intFindPrimitiveRoot(PrimeModulus);
-	// Randomly pick an exponent to encode with:
-	struct intChain* Exponent = intCryptoRandom(PrimeModulus);
-	// Raise the generator to the chosen exponent, reducing it mod the prime:
-	struct intChain* Exponential = intModExp(Generator, Exponent, PrimeModulus);
+// Built-in domain parameters: the 2048-bit MODP group of RFC 3526, with generator 2:
+//  The prime is safe, so 2 generates the subgroup of prime order (PrimeModulus - 1) / 2.
+static const char modp2048[] =
+    "FFFFFFFF FFFFFFFF C90FDAA2 2168C234 C4C6628B 80DC1CD1 29024E08 8A67CC74 020BBEA6 3B139B22 514A0879 8E3404DD"
+    "EF9519B3 CD3A431B 302B0A6D F25F1437 4FE1356D 6D51C245 E485B576 625E7EC6 F44C42E9 A637ED6B 0BFF5CB6 F406B7ED"
+    "EE386BFB 5A899FA5 AE9F2411 7C4B1FE6 49286651 ECE45B3D C2007CB8 A163BF05 98DA4836 1C55D39A 69163FA8 FD24CF5F"
+    "83655D23 DCA3AD96 1C62F356 208552BB 9ED52907 7096966D 670C354E 4ABC9804 F1746C08 CA18217C 32905E46 2E36CE3B"
+    "E39E772C 180E8603 9B2783A2 EC07A28F B5C55DF0 6F4C52C9 DE2BCBF6 95581718 3995497C EA956AE5 15D22618 98FA0510"
+    "15728E5A 8AACAA68 FFFFFFFF FFFFFFFF";
+
+// Shared domain parameters for bulk generation:
+//  Read-only while the workers run, so every thread uses the same ones.
+static struct domain {
+	uint64_t keySize;
+	struct intChain* PrimeModulus;
+	struct intChain* Generator;
+	struct intModulus* Modulus;
+	uint64_t formBits;      // PrimeModulus is 2^formBits - offset, if offset isn't 0
+	uint64_t offset;
+} domain;
+
+// Work shared by the bulk workers:
+static struct bulkPool {
+	pthread_mutex_t lock;
+	const char* prefix;
+	uint64_t count;
+	uint64_t next;          // index of the next key pair to generate
+	uint64_t failures;
+} pool;
+
+// Write a key pair as text key files:
+//  Returns 0 on success, 2 if the private key file can't be written, or 3 if the public key file can't be.
+//  A nonzero offset records the PrimeModulus as 2^formBits - offset in a ModulusForm field, which loaders ignore.
+static uint32_t writeKeyPair(
+    const char* privatePath,
+    const char* publicPath,
+    uint64_t keySize,
+    uint64_t formBits,
+    uint64_t offset,
+    const struct intChain* PrimeModulus,
+    const struct intChain* Generator,
+    const struct intChain* Exponent,
+    const struct intChain* Exponential
+) {
+	uint64_t writeStart = traceBegin();
 	// Generate parseable strings of these intChains:
 	char* strings[4];
 	strings[0] = intToString(PrimeModulus);
 	strings[1] = intToString(Generator);
 	strings[2] = intToString(Exponent);
 	strings[3] = intToString(Exponential);
-	FILE *fp = fopen(argv[2], "w");
+	uint32_t status = 0;
+	FILE *fp = fopen(privatePath, "w");
 	if (fp == 0) {
-		printf("Failed to open private key output file.");
-		return 2;
+		status = 2;
+	} else {
+		// Print out the private key:
+		fprintf(
+		    fp, "Private Key (%lu bits)\n\nPrimeModulus:\t%s\n\nGenerator:\t%s\n\nExponent:\t%s\n",
+		    keySize, strings[0], strings[1], strings[2]
+		);
+		if (offset) {
+			fprintf(fp, "\nModulusForm:\t2^%lu - %lu\n", formBits, offset);
+		}
+		fclose(fp);
+		fp = fopen(publicPath, "w");
+		if (fp == 0) {
+			status = 3;
+		} else {
+			// Print out the public key:
+			fprintf(
+			    fp, "Public Key (%lu bits)\n\nPrimeModulus:\t%s\n\nGenerator:\t%s\n\nExponential:\t%s\n",
+			    keySize, strings[0], strings[1], strings[3]
+			);
+			if (offset) {
+				fprintf(fp, "\nModulusForm:\t2^%lu - %lu\n", formBits, offset);
+			}
+			fclose(fp);
+		}
 	}
-	// Print out the private key:
-	fprintf(
-	    fp, "Private Key (%lu bits)\n\nPrimeModulus:\t%s\n\nGenerator:\t%s\n\nExponent:\t%s\n",
-	    keySize, strings[0], strings[1], strings[2]
-	);
-	fclose(fp);
-	fp = fopen(argv[3], "w");
-	if (fp == 0) {
-		printf("Failed to open public key output file.");
-		return 3;
-	}
-	// Print out the public key:
-	fprintf(
-	    fp, "Public Key (%lu bits)\n\nPrimeModulus:\t%s\n\nGenerator:\t%s\n\nExponential:\t%s\n",
-	    keySize, strings[0], strings[1], strings[3]
-	);
-	fclose(fp);
+	traceEnd("keyWrite", writeStart, status);
 	free(strings[0]);
 	free(strings[1]);
 	free(strings[2]);
 	free(strings[3]);
+	return status;
+}
+
+// Generate one key pair over a fresh prime modulus and generator:
+//  With pseudoMersenne set, the modulus is the largest safe prime 2^keySize - c with a small c, which every later
+//  exponentiation reduces by folding; keySize must then be a multiple of 64.
+//  Returns as writeKeyPair does, or 4 if there is no such prime.
+static uint32_t generateSingle(
+    uint64_t keySize,
+    uint32_t pseudoMersenne,
+    const char* privatePath,
+    const char* publicPath
+) {
+	uint64_t offset = 0;
+	struct intChain* PrimeModulus;
+	struct intChain* Generator;
+	if (pseudoMersenne) {
+		// Search down from 2^keySize for a safe prime, whose generators can be checked against both factors of p - 1:
+		PrimeModulus = intMakePseudoMersennePrime(keySize, &offset);
+		if (!PrimeModulus) {
+			return 4;
+		}
+		struct intChain* Two = intMake();
+		intIncrement(Two);
+		intIncrement(Two);
+		struct intChain* Half = intCopy(PrimeModulus);
+		intRShift(Half, 1);
+		const struct intChain* Factors[2] = {Two, Half};
+		Generator = intFindGenerator(PrimeModulus, Factors, 2);
+		intFree(Two);
+		intFree(Half);
+	} else {
+		// Randomly pick a prime modulus to use:
+		PrimeModulus = intMakePrime(keySize);
+		// Find a random primitive root of the prime modulus to use as a generator:
+		Generator = intFindPrimitiveRoot(PrimeModulus);
+	}
+	// Randomly pick an exponent to encode with:
+	struct intChain* Exponent = intCryptoRandom(PrimeModulus);
+	// Raise the generator to the chosen exponent, reducing it mod the prime:
+	struct intChain* Exponential = intModExp(Generator, Exponent, PrimeModulus);
+	uint32_t status = writeKeyPair(
+	    privatePath, publicPath, keySize, keySize, offset, PrimeModulus, Generator, Exponent, Exponential
+	);
 	intFree(PrimeModulus);
 	intFree(Generator);
 	intFree(Exponent);
 	intFree(Exponential);
+	return status;
+}
+
+// Generate key pairs over the shared domain until every index has been taken:
+//  Each pair costs one random exponent and one exponentiation.
+static void* bulkWorker(
+    void* argument
+) {
+	(void) argument;
+	uint64_t length = strlen(pool.prefix) + 32;
+	char* privatePath = malloc(length);
+	char* publicPath = malloc(length);
+	while (1) {
+		pthread_mutex_lock(&pool.lock);
+		uint64_t k = pool.next++;
+		pthread_mutex_unlock(&pool.lock);
+		if (k >= pool.count) {
+			break;
+		}
+		snprintf(privatePath, length, "%s.%" PRIu64 ".private", pool.prefix, k);
+		snprintf(publicPath, length, "%s.%" PRIu64 ".public", pool.prefix, k);
+		struct intChain* Exponent = intCryptoRandom(domain.PrimeModulus);
+		struct intChain* Exponential = intModulusExp(domain.Generator, Exponent, domain.Modulus);
+		uint32_t status = writeKeyPair(
+		    privatePath, publicPath, domain.keySize, domain.formBits, domain.offset,
+		    domain.PrimeModulus, domain.Generator, Exponent, Exponential
+		);
+		intFree(Exponent);
+		intFree(Exponential);
+		if (status) {
+			printf("Failed to write key pair %" PRIu64 ".\n", k);
+			pthread_mutex_lock(&pool.lock);
+			pool.failures++;
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+	free(privatePath);
+	free(publicPath);
+	intClearPool();
+	return 0;
+}
+
+// Generate count key pairs over the shared domain on workerCount threads:
+//  Returns the number of key pairs that couldn't be written, which is all of them if the domain is unusable.
+static uint64_t generateBulk(
+    const char* prefix,
+    uint64_t count,
+    uint32_t workerCount
+) {
+	domain.Modulus = intModulusMake(domain.PrimeModulus);
+	if (!domain.Modulus) {
+		printf("The domain's PrimeModulus is even.\n");
+		return count;
+	}
+	// A pseudo-Mersenne domain keeps its recorded form in every key made over it:
+	domain.offset = intModulusOffset(domain.Modulus, &domain.formBits);
+	pool.prefix = prefix;
+	pool.count = count;
+	pthread_mutex_init(&pool.lock, 0);
+	intShareable(domain.PrimeModulus);
+	intShareable(domain.Generator);
+	pthread_t* workers = malloc(workerCount * sizeof * workers);
+	uint32_t j;
+	for (j = 0; j < workerCount; j++) {
+		pthread_create(&workers[j], 0, bulkWorker, 0);
+	}
+	for (j = 0; j < workerCount; j++) {
+		pthread_join(workers[j], 0);
+	}
+	free(workers);
+	intModulusFree(domain.Modulus);
+	return pool.failures;
+}
+
+int main(int argc, char* argv[]) {
+	int option;
+	uint64_t count = 0;
+	uint32_t workerCount = 1;
+	const char* domainPath = 0;
+	const char* group = 0;
+	uint32_t pseudoMersenne = 0;
+	while ((option = getopt(argc, argv, "mn:j:d:g:")) != -1) {
+		if (option == 'm') {
+			pseudoMersenne = 1;
+		} else if (option == 'n') {
+			count = strtoull(optarg, 0, 10);
+		} else if (option == 'j') {
+			workerCount = strtoul(optarg, 0, 10);
+			if (workerCount == 0) {
+				workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+		} else if (option == 'd') {
+			domainPath = optarg;
+		} else if (option == 'g') {
+			group = optarg;
+		} else {
+			argc = 0;
+		}
+	}
+	uint32_t bulkMode = count || domainPath || group;
+	if (bulkMode && (!count || !domainPath == !group || pseudoMersenne)) {
+		argc = 0;
+	}
+	if (argc - optind < (bulkMode ? 1 : 3)) {
+		printf("Usage: %s [-m] keySize privateKeyFile publicKeyFile\n", argv[0]);
+		printf("       %s -n count [-j threads] (-d keyFile | -g modp2048) outputPrefix\n", argv[0]);
+		printf("\t-m\tuse the largest safe prime 2^keySize - c with a small c, which reduces faster; keySize must be a multiple of 64\n");
+		printf("\t-n\tgenerate this many key pairs over shared domain parameters, as outputPrefix.k.private and .public\n");
+		printf("\t-j\tgenerate on this many threads, or 0 for one per core (default 1)\n");
+		printf("\t-d\ttake the PrimeModulus and Generator of this key file\n");
+		printf("\t-g\ttake a built-in group; modp2048 is the 2048-bit MODP group of RFC 3526\n");
+		return 1;
+	}
+	argv += optind - 1;
+	if (!bulkMode) {
+		char* strEnd;
+		// Read the user's choice of key size:
+		uint64_t keySize = strtoll(argv[1], &strEnd, 10);
+		if (pseudoMersenne && (keySize < 128 || keySize % 64)) {
+			printf("Pseudo-Mersenne key sizes must be multiples of 64, from 128.\n");
+			return 1;
+		}
+		uint32_t status = generateSingle(keySize, pseudoMersenne, argv[2], argv[3]);
+		if (status == 2) {
+			printf("Failed to open private key output file.");
+		} else if (status == 3) {
+			printf("Failed to open public key output file.");
+		} else if (status == 4) {
+			printf("No pseudo-Mersenne safe prime of that size.\n");
+		}
+		return status;
+	}
+	struct keyFile key;
+	if (domainPath) {
+		uint32_t status = keyLoad(&key, domainPath);
+		if (status == 1) {
+			printf("Couldn't open keyFile.\n");
+			return 2;
+		} else if (status) {
+			printf("The key file is improperly formatted.\n");
+			return 3;
+		}
+		domain.keySize = key.keySize;
+		domain.PrimeModulus = intShare(key.PrimeModulus);
+		domain.Generator = intShare(key.Generator);
+		keyRelease(&key);
+	} else if (!strcmp(group, "modp2048")) {
+		domain.keySize = 2048;
+		domain.PrimeModulus = intFromHex(modp2048, sizeof modp2048 - 1);
+		domain.Generator = intMake();
+		intIncrement(domain.Generator);
+		intIncrement(domain.Generator);
+	} else {
+		printf("Unknown group %s.\n", group);
+		return 1;
+	}
+	uint64_t failures = generateBulk(argv[1], count, workerCount);
+	intFree(domain.PrimeModulus);
+	intFree(domain.Generator);
+	if (failures) {
+		printf("%" PRIu64 " of %" PRIu64 " key pairs failed.\n", failures, count);
+		return 9;
+	}
 	return 0;
 }
@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "keyring.h"
+#include "cipherText.h"
+
+// keyring.c
+// Cache of loaded key contexts, found by key id and kept within a memory budget.
+
+// Shards used when keyringMake is given 0:
+#define KEYRING_SHARDS 16
+
+// A registered key:
+//  Entries with a context loaded are on their shard's recency list, newest first.
+struct keyringEntry {
+	uint64_t keyId;
+	char* path;
+	uint32_t isPrivate;
+	struct elgamalPublic* publicKey;
+	struct elgamalPrivate* privateKey;
+	uint32_t publicHolds;       // callers holding publicKey
+	uint32_t privateHolds;      // callers holding privateKey
+	uint64_t bytes;             // footprint of the loaded contexts
+	struct keyringEntry* chain; // next entry in the same bucket
+	struct keyringEntry* newer;
+	struct keyringEntry* older;
+};
+
+// One independently locked part of a keyring:
+//  Aligned so that neighbouring shards' locks don't share a cache line.
+struct keyringShard {
+	pthread_mutex_t lock;
+	struct keyringEntry** buckets;
+	uint64_t bucketCount;       // always a power of two
+	uint64_t keys;
+	struct keyringEntry* newest;
+	struct keyringEntry* oldest;
+	uint64_t loaded;
+	uint64_t bytes;
+	uint64_t budget;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} __attribute__((aligned(64)));
+
+struct keyring {
+	uint32_t shardCount;        // always a power of two
+	struct keyringShard* shards;
+};
+
+// Find the shard a key id belongs to:
+//  Key ids are hashes, so their low bits pick the shard and the bits above them the bucket.
+static struct keyringShard* shardOf(
+    struct keyring* ring,
+    uint64_t keyId
+) {
+	return &ring->shards[keyId & (ring->shardCount - 1)];
+}
+
+static struct keyringEntry** bucketOf(
+    struct keyring* ring,
+    struct keyringShard* shard,
+    uint64_t keyId
+) {
+	return &shard->buckets[(keyId / ring->shardCount) & (shard->bucketCount - 1)];
+}
+
+// Find a registered key in its shard, whose lock must be held:
+static struct keyringEntry* findEntry(
+    struct keyring* ring,
+    struct keyringShard* shard,
+    uint64_t keyId
+) {
+	struct keyringEntry* entry = *bucketOf(ring, shard, keyId);
+	while (entry && entry->keyId != keyId) {
+		entry = entry->chain;
+	}
+	return entry;
+}
+
+// Double a shard's buckets once it holds more keys than buckets:
+static void growBuckets(
+    struct keyring* ring,
+    struct keyringShard* shard
+) {
+	struct keyringEntry** old = shard->buckets;
+	uint64_t oldCount = shard->bucketCount;
+	shard->bucketCount *= 2;
+	shard->buckets = calloc(shard->bucketCount, sizeof * shard->buckets);
+	assert(shard->buckets);
+	uint64_t j;
+	for (j = 0; j < oldCount; j++) {
+		struct keyringEntry* entry = old[j];
+		while (entry) {
+			struct keyringEntry* next = entry->chain;
+			struct keyringEntry** bucket = bucketOf(ring, shard, entry->keyId);
+			entry->chain = *bucket;
+			*bucket = entry;
+			entry = next;
+		}
+	}
+	free(old);
+}
+
+// Take an entry off its shard's recency list:
+static void unlinkEntry(
+    struct keyringShard* shard,
+    struct keyringEntry* entry
+) {
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		shard->newest = entry->older;
+	}
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		shard->oldest = entry->newer;
+	}
+	entry->newer = 0;
+	entry->older = 0;
+}
+
+// Put an entry at the front of its shard's recency list, taking it out of its old place if it has one:
+static void touchEntry(
+    struct keyringShard* shard,
+    struct keyringEntry* entry
+) {
+	if (shard->newest == entry) {
+		return;
+	}
+	if (entry->newer || entry->older || shard->oldest == entry) {
+		unlinkEntry(shard, entry);
+	}
+	entry->older = shard->newest;
+	if (shard->newest) {
+		shard->newest->newer = entry;
+	} else {
+		shard->oldest = entry;
+	}
+	shard->newest = entry;
+}
+
+// Record a newly loaded context's footprint:
+static void addBytes(
+    struct keyringShard* shard,
+    struct keyringEntry* entry,
+    uint64_t bytes
+) {
+	if (!entry->bytes) {
+		shard->loaded++;
+	}
+	entry->bytes += bytes;
+	shard->bytes += bytes;
+}
+
+// Free the contexts of an entry that nobody holds:
+static void dropContexts(
+    struct keyringShard* shard,
+    struct keyringEntry* entry
+) {
+	if (entry->publicKey && !entry->publicHolds) {
+		uint64_t bytes = elgamalPublicFootprint(entry->publicKey);
+		elgamalPublicFree(entry->publicKey);
+		entry->publicKey = 0;
+		entry->bytes -= bytes;
+		shard->bytes -= bytes;
+		shard->evictions++;
+	}
+	if (entry->privateKey && !entry->privateHolds) {
+		uint64_t bytes = elgamalPrivateFootprint(entry->privateKey);
+		elgamalPrivateFree(entry->privateKey);
+		entry->privateKey = 0;
+		entry->bytes -= bytes;
+		shard->bytes -= bytes;
+		shard->evictions++;
+	}
+	if (!entry->publicKey && !entry->privateKey) {
+		entry->bytes = 0;
+		shard->loaded--;
+		unlinkEntry(shard, entry);
+	}
+}
+
+// Free contexts from the least recently used end until the shard fits its budget again:
+//  Contexts still held are skipped.
+static void evict(
+    struct keyringShard* shard
+) {
+	struct keyringEntry* entry = shard->oldest;
+	while (entry && shard->bytes > shard->budget) {
+		struct keyringEntry* newer = entry->newer;
+		dropContexts(shard, entry);
+		entry = newer;
+	}
+}
+
+struct keyring* keyringMake(
+    uint64_t budget,
+    uint32_t shards
+) {
+	if (shards == 0) {
+		shards = KEYRING_SHARDS;
+	}
+	uint32_t shardCount = 1;
+	while (shardCount < shards) {
+		shardCount *= 2;
+	}
+	struct keyring* ring = malloc(sizeof * ring);
+	assert(ring);
+	ring->shardCount = shardCount;
+	ring->shards = aligned_alloc(64, shardCount * sizeof * ring->shards);
+	assert(ring->shards);
+	memset(ring->shards, 0, shardCount * sizeof * ring->shards);
+	uint32_t j;
+	for (j = 0; j < shardCount; j++) {
+		struct keyringShard* shard = &ring->shards[j];
+		pthread_mutex_init(&shard->lock, 0);
+		shard->bucketCount = 8;
+		shard->buckets = calloc(shard->bucketCount, sizeof * shard->buckets);
+		assert(shard->buckets);
+		shard->budget = budget / shardCount;
+	}
+	return ring;
+}
+
+void keyringFree(
+    struct keyring* ring
+) {
+	uint32_t j;
+	for (j = 0; j < ring->shardCount; j++) {
+		struct keyringShard* shard = &ring->shards[j];
+		uint64_t k;
+		for (k = 0; k < shard->bucketCount; k++) {
+			struct keyringEntry* entry = shard->buckets[k];
+			while (entry) {
+				struct keyringEntry* next = entry->chain;
+				assert(!entry->publicHolds && !entry->privateHolds);
+				if (entry->publicKey) {
+					elgamalPublicFree(entry->publicKey);
+				}
+				if (entry->privateKey) {
+					elgamalPrivateFree(entry->privateKey);
+				}
+				free(entry->path);
+				free(entry);
+				entry = next;
+			}
+		}
+		free(shard->buckets);
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(ring->shards);
+	free(ring);
+}
+
+uint32_t keyringAdd(
+    struct keyring* ring,
+    const char* path,
+    uint64_t* keyId
+) {
+	uint32_t status;
+	struct elgamalPrivate* privateKey = elgamalPrivateLoad(path, &status);
+	struct elgamalPublic* publicKey = 0;
+	uint64_t id;
+	if (privateKey) {
+		id = elgamalPrivateKeyId(privateKey);
+	} else {
+		publicKey = elgamalPublicLoad(path, &status);
+		if (!publicKey) {
+			return status;
+		}
+		id = elgamalPublicKeyId(publicKey);
+	}
+	if (keyId) {
+		*keyId = id;
+	}
+	struct keyringShard* shard = shardOf(ring, id);
+	pthread_mutex_lock(&shard->lock);
+	struct keyringEntry* entry = findEntry(ring, shard, id);
+	if (!entry) {
+		entry = calloc(1, sizeof * entry);
+		assert(entry);
+		entry->keyId = id;
+		if (++shard->keys > shard->bucketCount) {
+			growBuckets(ring, shard);
+		}
+		struct keyringEntry** bucket = bucketOf(ring, shard, id);
+		entry->chain = *bucket;
+		*bucket = entry;
+	}
+	// A private key file serves both kinds of context, so a public one never replaces it:
+	if (privateKey || !entry->isPrivate) {
+		free(entry->path);
+		entry->path = strdup(path);
+		assert(entry->path);
+		entry->isPrivate = privateKey != 0;
+	}
+	// Keep what was just loaded, unless a context is already there:
+	if (privateKey && !entry->privateKey) {
+		entry->privateKey = privateKey;
+		addBytes(shard, entry, elgamalPrivateFootprint(privateKey));
+		privateKey = 0;
+	} else if (publicKey && !entry->publicKey) {
+		entry->publicKey = publicKey;
+		addBytes(shard, entry, elgamalPublicFootprint(publicKey));
+		publicKey = 0;
+	}
+	if (entry->bytes) {
+		touchEntry(shard, entry);
+	}
+	evict(shard);
+	pthread_mutex_unlock(&shard->lock);
+	if (privateKey) {
+		elgamalPrivateFree(privateKey);
+	}
+	if (publicKey) {
+		elgamalPublicFree(publicKey);
+	}
+	return 0;
+}
+
+// Take a context of a registered key, loading it outside the shard's lock if it isn't loaded:
+//  wantPrivate picks the kind. If two threads load the same key at once, the first one in is kept.
+static void* takeContext(
+    struct keyring* ring,
+    uint64_t keyId,
+    uint32_t wantPrivate
+) {
+	struct keyringShard* shard = shardOf(ring, keyId);
+	pthread_mutex_lock(&shard->lock);
+	struct keyringEntry* entry = findEntry(ring, shard, keyId);
+	if (!entry || (wantPrivate && !entry->isPrivate)) {
+		pthread_mutex_unlock(&shard->lock);
+		return 0;
+	}
+	if (wantPrivate ? entry->privateKey != 0 : entry->publicKey != 0) {
+		void* key;
+		if (wantPrivate) {
+			entry->privateHolds++;
+			key = entry->privateKey;
+		} else {
+			entry->publicHolds++;
+			key = entry->publicKey;
+		}
+		shard->hits++;
+		touchEntry(shard, entry);
+		pthread_mutex_unlock(&shard->lock);
+		return key;
+	}
+	shard->misses++;
+	char* path = strdup(entry->path);
+	assert(path);
+	pthread_mutex_unlock(&shard->lock);
+	struct elgamalPrivate* privateKey = 0;
+	struct elgamalPublic* publicKey = 0;
+	if (wantPrivate) {
+		privateKey = elgamalPrivateLoad(path, 0);
+	} else {
+		publicKey = elgamalPublicLoad(path, 0);
+	}
+	free(path);
+	// The file may have changed since it was registered:
+	if ((privateKey && elgamalPrivateKeyId(privateKey) != keyId)
+	        || (publicKey && elgamalPublicKeyId(publicKey) != keyId)) {
+		if (privateKey) {
+			elgamalPrivateFree(privateKey);
+		}
+		if (publicKey) {
+			elgamalPublicFree(publicKey);
+		}
+		return 0;
+	}
+	if (!privateKey && !publicKey) {
+		return 0;
+	}
+	pthread_mutex_lock(&shard->lock);
+	void* key;
+	if (wantPrivate) {
+		if (entry->privateKey) {
+			elgamalPrivateFree(privateKey);
+		} else {
+			entry->privateKey = privateKey;
+			addBytes(shard, entry, elgamalPrivateFootprint(privateKey));
+		}
+		entry->privateHolds++;
+		key = entry->privateKey;
+	} else {
+		if (entry->publicKey) {
+			elgamalPublicFree(publicKey);
+		} else {
+			entry->publicKey = publicKey;
+			addBytes(shard, entry, elgamalPublicFootprint(publicKey));
+		}
+		entry->publicHolds++;
+		key = entry->publicKey;
+	}
+	touchEntry(shard, entry);
+	evict(shard);
+	pthread_mutex_unlock(&shard->lock);
+	return key;
+}
+
+struct elgamalPublic* keyringPublic(
+    struct keyring* ring,
+    uint64_t keyId
+) {
+	return takeContext(ring, keyId, 0);
+}
+
+struct elgamalPrivate* keyringPrivate(
+    struct keyring* ring,
+    uint64_t keyId
+) {
+	return takeContext(ring, keyId, 1);
+}
+
+void keyringPutPublic(
+    struct keyring* ring,
+    struct elgamalPublic* key
+) {
+	uint64_t keyId = elgamalPublicKeyId(key);
+	struct keyringShard* shard = shardOf(ring, keyId);
+	pthread_mutex_lock(&shard->lock);
+	struct keyringEntry* entry = findEntry(ring, shard, keyId);
+	assert(entry && entry->publicKey == key && entry->publicHolds);
+	entry->publicHolds--;
+	evict(shard);
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void keyringPutPrivate(
+    struct keyring* ring,
+    struct elgamalPrivate* key
+) {
+	uint64_t keyId = elgamalPrivateKeyId(key);
+	struct keyringShard* shard = shardOf(ring, keyId);
+	pthread_mutex_lock(&shard->lock);
+	struct keyringEntry* entry = findEntry(ring, shard, keyId);
+	assert(entry && entry->privateKey == key && entry->privateHolds);
+	entry->privateHolds--;
+	evict(shard);
+	pthread_mutex_unlock(&shard->lock);
+}
+
+uint8_t* keyringDecryptBuffer(
+    struct keyring* ring,
+    const uint8_t* cipher,
+    uint64_t cipherLength,
+    uint64_t* length,
+    uint32_t* status
+) {
+	struct cipherMap map;
+	if (cipherMapBuffer(&map, cipher, cipherLength)) {
+		cipherMapClose(&map);
+		if (status) {
+			*status = 2;
+		}
+		return 0;
+	}
+	uint64_t keyId = map.header.keyId;
+	cipherMapClose(&map);
+	struct elgamalPrivate* key = keyringPrivate(ring, keyId);
+	if (!key) {
+		if (status) {
+			*status = 3;
+		}
+		return 0;
+	}
+	uint8_t* data = elgamalDecryptBuffer(key, cipher, cipherLength, length, status);
+	keyringPutPrivate(ring, key);
+	return data;
+}
+
+void keyringReadStats(
+    struct keyring* ring,
+    struct keyringStats* stats
+) {
+	memset(stats, 0, sizeof * stats);
+	uint32_t j;
+	for (j = 0; j < ring->shardCount; j++) {
+		struct keyringShard* shard = &ring->shards[j];
+		pthread_mutex_lock(&shard->lock);
+		stats->keys += shard->keys;
+		stats->loaded += shard->loaded;
+		stats->bytes += shard->bytes;
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
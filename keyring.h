@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+
+#include "elgamal.h"
+
+// keyring.h
+// Cache of loaded key contexts for servers handling many keys, found by key id and kept within a memory budget.
+//  Keys are registered by path once; their contexts are loaded on first use, shared by every thread that asks for
+//  them, and evicted least recently used first when a shard goes over its share of the budget. An evicted key is
+//  loaded again from its path the next time it is asked for. Keys are spread over shards by id, each with its own
+//  lock, so requests for different keys rarely wait on each other, and lookups of loaded keys never wait on a load.
+
+struct keyring;
+
+// Counters kept by a keyring, summed over its shards:
+struct keyringStats {
+	uint64_t keys;          // keys registered
+	uint64_t loaded;        // contexts currently loaded
+	uint64_t bytes;         // approximate memory held by loaded contexts
+	uint64_t hits;          // lookups answered by a loaded context
+	uint64_t misses;        // lookups that had to load a context
+	uint64_t evictions;     // contexts freed to stay within the budget
+};
+
+// Make an empty keyring:
+//  budget is the approximate memory, in bytes, that loaded contexts may hold; contexts in use are never evicted, so
+//  it can be exceeded while they are. shards is rounded up to a power of two; 0 picks a default.
+struct keyring* keyringMake(
+    uint64_t budget,    // bytes that loaded contexts may hold
+    uint32_t shards     // number of independently locked shards
+);
+
+// Free a keyring and every context it holds:
+//  No context taken from it may still be in use.
+void keyringFree(
+    struct keyring* ring
+);
+
+// Register a key file or bundle, loading it once to learn its id:
+//  Returns 0 on success, 1 if the file can't be read, or 2 if it is improperly formatted. Registering a path for an
+//  id that is already registered replaces its path, except that a public key never replaces a private one.
+uint32_t keyringAdd(
+    struct keyring* ring,
+    const char* path,       // key file or bundle
+    uint64_t* keyId         // receives the key's id; may be 0
+);
+
+// Take the public context of a registered key, loading it if needed:
+//  Returns 0 if the id isn't registered or the key can no longer be loaded. Hand it back with keyringPutPublic.
+struct elgamalPublic* keyringPublic(
+    struct keyring* ring,
+    uint64_t keyId
+);
+
+// Take the private context of a registered private key, loading it if needed:
+//  Returns 0 if the id isn't registered as a private key or the key can no longer be loaded.
+//  Hand it back with keyringPutPrivate.
+struct elgamalPrivate* keyringPrivate(
+    struct keyring* ring,
+    uint64_t keyId
+);
+
+// Hand back contexts taken from a keyring, letting them be evicted again once nothing else holds them:
+void keyringPutPublic(
+    struct keyring* ring,
+    struct elgamalPublic* key
+);
+void keyringPutPrivate(
+    struct keyring* ring,
+    struct elgamalPrivate* key
+);
+
+// Decrypt a binary ciphertext container with whichever registered private key it names:
+//  Returns 0 on failure, with status as for elgamalDecryptBuffer, or 3 if no registered private key has its id.
+uint8_t* keyringDecryptBuffer(
+    struct keyring* ring,
+    const uint8_t* cipher,      // ciphertext container
+    uint64_t cipherLength,      // size of the container
+    uint64_t* length,           // receives the bytes of plaintext
+    uint32_t* status            // receives the failure reason; may be 0
+);
+
+// Read the keyring's counters:
+void keyringReadStats(
+    struct keyring* ring,
+    struct keyringStats* stats  // receives the totals
+);
@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+// trace.c
+// Phase tracing in Chrome trace-event format.
+
+// Whether the environment has been checked yet, and what it said:
+#define TRACE_UNKNOWN 0
+#define TRACE_OFF 1
+#define TRACE_ON 2
+
+static uint32_t traceState = TRACE_UNKNOWN;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* traceFile;
+static uint64_t eventCount;
+
+static uint64_t traceNanoseconds(
+    void
+) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+} // O(1)
+
+// Open the trace file named by the environment, the first time any thread asks:
+static uint32_t traceOpen(
+    void
+) {
+	pthread_mutex_lock(&traceLock);
+	if (traceState == TRACE_UNKNOWN) {
+		const char* path = getenv("ELGAMAL_TRACE");
+		traceFile = path ? fopen(path, "w") : 0;
+		if (traceFile) {
+			fprintf(traceFile, "{\"traceEvents\": [\n");
+		}
+		__atomic_store_n(&traceState, traceFile ? TRACE_ON : TRACE_OFF, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&traceLock);
+	return traceState;
+} // O(1)
+
+// Finish the JSON when the program ends:
+static void __attribute__((destructor)) traceClose(void) {
+	pthread_mutex_lock(&traceLock);
+	if (traceFile) {
+		fprintf(traceFile, "\n]}\n");
+		fclose(traceFile);
+		traceFile = 0;
+		traceState = TRACE_OFF;
+	}
+	pthread_mutex_unlock(&traceLock);
+} // O(1)
+
+// Start timing a phase:
+uint64_t traceBegin(
+    void
+) {
+	uint32_t state = __atomic_load_n(&traceState, __ATOMIC_ACQUIRE);
+	if (state == TRACE_UNKNOWN) {
+		state = traceOpen();
+	}
+	return state == TRACE_ON ? traceNanoseconds() : 0;
+} // O(1)
+
+// Record a phase that started at start:
+void traceEnd(
+    const char* name,
+    uint64_t start,
+    int64_t argument
+) {
+	if (!start) {
+		return;
+	}
+	uint64_t end = traceNanoseconds();
+	static __thread long threadId;
+	if (!threadId) {
+		threadId = syscall(SYS_gettid);
+	}
+	pthread_mutex_lock(&traceLock);
+	if (traceFile) {
+		// Complete ("X") events carry their own duration; times are in microseconds.
+		fprintf(
+		    traceFile,
+		    "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %ld, "
+		    "\"args\": {\"n\": %" PRId64 "}}",
+		    eventCount++ ? ",\n" : "", name, start / 1e3, (end - start) / 1e3, (int) getpid(), threadId, argument
+		);
+	}
+	pthread_mutex_unlock(&traceLock);
+} // O(1)
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// trace.h
+// Phase tracing in Chrome trace-event format, for chrome://tracing or Perfetto:
+//  Set the ELGAMAL_TRACE environment variable to a file name to record; otherwise every call is one branch.
+
+// Start timing a phase:
+//  Returns the start time to hand to traceEnd, or 0 if tracing is off.
+uint64_t traceBegin(
+    void
+);
+
+// Record a phase that started at start:
+//  Does nothing if start is 0. name must be a plain identifier, since it is written into the JSON as is.
+void traceEnd(
+    const char* name,   // name of the phase
+    uint64_t start,     // value returned by traceBegin
+    int64_t argument    // recorded with the event, such as a round or block number
+);